@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "archive.hh"
+
+namespace {
+
+const char Signature[8] = { 'O', 'D', 'A', 'R', 'C', 'H', 'V', '1' };
+
+enum {
+	HEADER_SIZE = 24,
+	ENTRY_SIZE = 32,
+};
+
+void Put32(std::string& out, uint32_t value) {
+	for (int i = 0; i < 4; i++)
+		out.push_back((char)((value >> (i * 8)) & 0xff));
+}
+
+void Put64(std::string& out, uint64_t value) {
+	for (int i = 0; i < 8; i++)
+		out.push_back((char)((value >> (i * 8)) & 0xff));
+}
+
+uint32_t Get32(const char* in) {
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++)
+		value |= (uint32_t)(unsigned char)in[i] << (i * 8);
+	return value;
+}
+
+uint64_t Get64(const char* in) {
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value |= (uint64_t)(unsigned char)in[i] << (i * 8);
+	return value;
+}
+
+uint64_t Align(uint64_t offset, uint32_t alignment) {
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+struct ScopedFd {
+	int fd;
+
+	~ScopedFd() {
+		if (fd != -1)
+			close(fd);
+	}
+};
+
+void ReadAt(int fd, char* buffer, size_t length, off_t offset) {
+	size_t total = 0;
+	while (total < length) {
+		ssize_t nread = pread(fd, buffer + total, length - total, offset + total);
+		if (nread <= 0)
+			throw std::runtime_error("cannot read data archive index");
+		total += nread;
+	}
+}
+
+}
+
+Archive::EntryVector Archive::ReadIndex(const std::string& path) {
+	ScopedFd file = { open(path.c_str(), O_RDONLY) };
+	if (file.fd == -1)
+		throw std::runtime_error("cannot open data archive");
+
+	struct stat st;
+	if (fstat(file.fd, &st) != 0)
+		throw std::runtime_error("cannot stat data archive");
+
+	uint64_t file_size = st.st_size;
+	if (file_size < HEADER_SIZE)
+		throw std::runtime_error("not a data archive");
+
+	char header[HEADER_SIZE];
+	ReadAt(file.fd, header, sizeof(header), 0);
+
+	if (memcmp(header, Signature, sizeof(Signature)) != 0)
+		throw std::runtime_error("not a data archive");
+
+	uint32_t num_entries = Get32(header + 8);
+	uint64_t pool_size = Get64(header + 16);
+
+	// index must fit into the file, which also bounds both counts
+	// before anything is allocated for them
+	uint64_t index_space = file_size - HEADER_SIZE;
+	if ((uint64_t)num_entries > index_space / ENTRY_SIZE || pool_size > index_space - (uint64_t)num_entries * ENTRY_SIZE)
+		throw std::runtime_error("data archive index is corrupt");
+
+	uint64_t index_end = HEADER_SIZE + (uint64_t)num_entries * ENTRY_SIZE + pool_size;
+
+	std::vector<char> index(index_end - HEADER_SIZE);
+	ReadAt(file.fd, index.data(), index.size(), HEADER_SIZE);
+
+	const char* pool = index.data() + (size_t)num_entries * ENTRY_SIZE;
+
+	EntryVector entries;
+	entries.reserve(num_entries);
+	for (uint32_t i = 0; i < num_entries; i++) {
+		const char* rawentry = index.data() + i * ENTRY_SIZE;
+
+		uint32_t name_offset = Get32(rawentry);
+		uint32_t name_length = Get32(rawentry + 4);
+		if ((uint64_t)name_offset + name_length > pool_size)
+			throw std::runtime_error("data archive index is corrupt");
+
+		uint64_t offset = Get64(rawentry + 8);
+		uint64_t size = Get64(rawentry + 16);
+		if (offset < index_end || offset > file_size || size > file_size - offset)
+			throw std::runtime_error("data archive entry is out of archive bounds");
+
+		entries.push_back({
+				std::string(pool + name_offset, name_length),
+				offset,
+				size,
+				(int64_t)Get64(rawentry + 24)
+			});
+	}
+
+	return entries;
+}
+
+void Archive::Write(const std::string& path, const SourceVector& unsorted_sources, uint32_t alignment) {
+	SourceVector sources(unsorted_sources);
+	std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) { return a.name < b.name; });
+
+	// string pool
+	std::string pool;
+	for (auto& source : sources)
+		pool += source.name;
+
+	// header
+	std::string index;
+	index.append(Signature, sizeof(Signature));
+	Put32(index, sources.size());
+	Put32(index, alignment);
+	Put64(index, pool.size());
+
+	// entries
+	uint64_t offset = Align(HEADER_SIZE + sources.size() * ENTRY_SIZE + pool.size(), alignment);
+	uint32_t name_offset = 0;
+	for (auto& source : sources) {
+		Put32(index, name_offset);
+		Put32(index, source.name.length());
+		Put64(index, offset);
+		Put64(index, source.size);
+		Put64(index, (uint64_t)source.mtime);
+
+		name_offset += source.name.length();
+		offset = Align(offset + source.size, alignment);
+	}
+
+	index += pool;
+
+	// write everything
+	std::ofstream stream(path, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+	stream.exceptions(std::ofstream::badbit | std::ofstream::failbit);
+
+	stream.write(index.data(), index.size());
+
+	std::vector<char> buffer(1024 * 1024);
+	for (auto& source : sources) {
+		// pad to alignment
+		std::vector<char> padding(Align(stream.tellp(), alignment) - stream.tellp(), '\0');
+		stream.write(padding.data(), padding.size());
+
+		std::ifstream input(source.path, std::ios_base::in | std::ios_base::binary);
+		if (!input.is_open())
+			throw std::runtime_error("cannot open " + source.path);
+
+		uint64_t remaining = source.size;
+		while (remaining > 0) {
+			size_t chunk = std::min<uint64_t>(remaining, buffer.size());
+			input.read(buffer.data(), chunk);
+			if (input.gcount() != (std::streamsize)chunk)
+				throw std::runtime_error("cannot read " + source.path);
+			stream.write(buffer.data(), chunk);
+			remaining -= chunk;
+		}
+	}
+}
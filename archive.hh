@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCHIVE_HH
+#define ARCHIVE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Single file archive of game data
+//
+// Layout (all integers are little endian):
+//
+//   header:
+//     char[8]  signature "ODARCHV1"
+//     uint32   number of entries
+//     uint32   payload alignment
+//     uint64   size of string pool
+//   entries, sorted by name:
+//     uint32   offset of name in string pool
+//     uint32   length of name
+//     uint64   offset of payload from the start of archive
+//     uint64   size of payload
+//     int64    mtime of original file
+//   string pool
+//   payloads, each aligned to payload alignment
+//
+// Names are lower-cased file names without directories, same
+// as used by DataManager for lookups.
+class Archive {
+public:
+	struct Entry {
+		std::string name;
+		uint64_t offset;
+		uint64_t size;
+		int64_t mtime;
+	};
+
+	struct Source {
+		std::string name;
+		std::string path;
+		uint64_t size;
+		int64_t mtime;
+	};
+
+	typedef std::vector<Entry> EntryVector;
+	typedef std::vector<Source> SourceVector;
+
+public:
+	static EntryVector ReadIndex(const std::string& path);
+	static void Write(const std::string& path, const SourceVector& sources, uint32_t alignment = 4096);
+};
+
+#endif // ARCHIVE_HH
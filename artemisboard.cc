@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include "artemisboard.hh"
+
+const std::array<ArtemisBoard::PieceType, ArtemisBoard::NUM_PIECES> ArtemisBoard::initial_pieces_ = { {
+	DR, UL, DR, VE, UL, DR, UL, HO, UL,
+	DR, DL, DR, UR, VE, HO, DR, DR, UL,
+	UL, DR, VE, DR, UR, DR, UL, VE, HO,
+	DR, HO, DR, UL, DR, UR, HO, HO, DL, // central piece is not used
+	UR, VE, UL, UR, DR, UL, VE, UR, DL,
+	DR, UL, HO, UL, VE, DR, DR, DR, VE,
+	DR, HO, DR, UR, UL, UL, HO, DR, UR,
+} };
+
+// outgoing direction for each piece type and incoming direction,
+// or -1 if the piece doesn't accept power from that side
+const std::array<std::array<signed char, 4>, 6> ArtemisBoard::turns_ = { {
+	//  LEFT   RIGHT  UP     DOWN
+	{ { DOWN,  -1,    RIGHT, -1    } }, // DR
+	{ { -1,    DOWN,  LEFT,  -1    } }, // DL
+	{ { -1,    UP,    -1,    LEFT  } }, // UL
+	{ { UP,    -1,    -1,    RIGHT } }, // UR
+	{ { LEFT,  RIGHT, -1,    -1    } }, // HO
+	{ { -1,    -1,    UP,    DOWN  } }, // VE
+} };
+
+const std::array<int, 4> ArtemisBoard::dx_ = { { -1, 1, 0, 0 } };
+const std::array<int, 4> ArtemisBoard::dy_ = { { 0, 0, -1, 1 } };
+
+// Search for minimal solution
+//
+// All four paths from the center must end at distinct systems, and
+// since every piece has exactly two sides connected, paths never
+// share pieces. So the solution is built path by path, choosing
+// orientation for every piece entered: straight pieces have single
+// suitable orientation, corners have two. This is IDA* with cost
+// being number of clicks, and the heuristic being the cost of
+// reaching nearest free system from each path's head, calculated
+// for every piece ignoring the requirement of paths not crossing.
+class ArtemisBoard::Solver {
+private:
+	enum {
+		INF = std::numeric_limits<int>::max() / 2,
+	};
+
+	struct Option {
+		int orientation;
+		int out;
+		int cost;
+	};
+
+	struct Options {
+		int count;
+		Option options[2];
+	};
+
+private:
+	const ArtemisBoard& board_;
+
+	// suitable orientations of each piece for each incoming direction
+	std::array<std::array<Options, 4>, NUM_PIECES> options_;
+
+	// lower bound of cost of reaching each system from each piece
+	// and incoming direction
+	std::array<std::array<std::array<int, 4>, NUM_PIECES>, 4> dist_;
+
+	// search state
+	Mask used_;
+	int systems_;
+	int threshold_;
+	int next_threshold_;
+	std::array<int, NUM_PIECES> targets_;
+
+private:
+	static int SystemIndex(int system) {
+		switch (system) {
+		case AUX_BIO_SYSTEMS: return 0;
+		case AUX_CONTROL_SYSTEM: return 1;
+		case AUX_AIR_REFILTRATION: return 2;
+		case AUX_POWER_GRID: return 3;
+		}
+		return -1;
+	}
+
+	int GetRotationCost(int n, int orientation) const {
+		int current = board_.GetOrientation(n);
+
+		if (Test(board_.straight_, n))
+			return current != orientation;
+
+		int clockwise_steps = (orientation - current) & 3;
+#ifdef BUG2BUG
+		return clockwise_steps;
+#else
+		return std::min(clockwise_steps, 4 - clockwise_steps);
+#endif
+	}
+
+	void CalculateOptions() {
+		for (int n = 0; n < NUM_PIECES; n++) {
+			bool straight = Test(board_.straight_, n);
+			for (int dir = 0; dir < 4; dir++) {
+				Options& opts = options_[n][dir];
+				opts.count = 0;
+				for (int orientation = 0; orientation < (straight ? 2 : 4); orientation++) {
+					int out = turns_[straight ? HO + orientation : orientation][dir];
+					if (out != -1)
+						opts.options[opts.count++] = Option{ orientation, out, GetRotationCost(n, orientation) };
+				}
+
+				// try cheaper option first
+				if (opts.count == 2 && opts.options[1].cost < opts.options[0].cost)
+					std::swap(opts.options[0], opts.options[1]);
+			}
+		}
+	}
+
+	void CalculateDistances() {
+		for (int system = 0; system < 4; system++) {
+			auto& dist = dist_[system];
+			for (auto& piece : dist)
+				piece.fill(INF);
+
+			// relax until stable; costs are small, so it
+			// converges in few passes
+			bool changed = true;
+			while (changed) {
+				changed = false;
+				for (int n = 0; n < NUM_PIECES; n++) {
+					if (n == CENTRAL_PIECE_NUMBER)
+						continue;
+
+					for (int dir = 0; dir < 4; dir++) {
+						int best = dist[n][dir];
+						const Options& opts = options_[n][dir];
+						for (int i = 0; i < opts.count; i++) {
+							const Option& opt = opts.options[i];
+							int x = n % NUM_COLUMNS + dx_[opt.out];
+							int y = n / NUM_COLUMNS + dy_[opt.out];
+
+							int rest;
+							if (x < 0 || y < 0 || x >= NUM_COLUMNS || y >= NUM_ROWS)
+								rest = SystemIndex(GetExitSystem(x, y)) == system ? 0 : INF;
+							else
+								rest = dist[y * NUM_COLUMNS + x][opt.out];
+
+							best = std::min(best, opt.cost + rest);
+						}
+
+						if (best < dist[n][dir]) {
+							dist[n][dir] = best;
+							changed = true;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	int GetDistance(int n, int dir) const {
+		int best = INF;
+		for (int system = 0; system < 4; system++)
+			if (!(systems_ & (1 << system)))
+				best = std::min(best, dist_[system][n][dir]);
+		return best;
+	}
+
+	int GetHeuristic(int n, int dir, int path) const {
+		int total = GetDistance(n, dir);
+		for (int next = path + 1; next < 4 && total < INF; next++)
+			total += GetDistance(CENTRAL_PIECE_NUMBER + dy_[next] * NUM_COLUMNS + dx_[next], next);
+		return std::min<int>(total, INF);
+	}
+
+	// enter position x, y moving in given direction as part of
+	// given path
+	bool Search(int x, int y, int dir, int path, int cost) {
+		if (x < 0 || y < 0 || x >= NUM_COLUMNS || y >= NUM_ROWS) {
+			int system = SystemIndex(GetExitSystem(x, y));
+			if (system == -1 || (systems_ & (1 << system)))
+				return false;
+
+			if (cost > threshold_) {
+				next_threshold_ = std::min(next_threshold_, cost);
+				return false;
+			}
+
+			if (path == 3)
+				return true;
+
+			systems_ |= 1 << system;
+			if (Search(CENTRAL_COLUMN + dx_[path + 1], CENTRAL_ROW + dy_[path + 1], path + 1, path + 1, cost))
+				return true;
+			systems_ &= ~(1 << system);
+			return false;
+		}
+
+		int n = y * NUM_COLUMNS + x;
+		if (n == CENTRAL_PIECE_NUMBER || Test(used_, n))
+			return false;
+
+		int estimate = cost + GetHeuristic(n, dir, path);
+		if (estimate > threshold_) {
+			next_threshold_ = std::min(next_threshold_, estimate);
+			return false;
+		}
+
+		used_ |= (Mask)1 << n;
+
+		const Options& opts = options_[n][dir];
+		for (int i = 0; i < opts.count; i++) {
+			const Option& opt = opts.options[i];
+			targets_[n] = opt.orientation;
+			if (Search(x + dx_[opt.out], y + dy_[opt.out], opt.out, path, cost + opt.cost))
+				return true;
+		}
+
+		used_ &= ~((Mask)1 << n);
+		targets_[n] = -1;
+		return false;
+	}
+
+public:
+	Solver(const ArtemisBoard& board) : board_(board), used_(0), systems_(0), threshold_(0), next_threshold_(INF) {
+		targets_.fill(-1);
+		CalculateOptions();
+		CalculateDistances();
+	}
+
+	bool Solve(std::vector<Move>& moves) {
+		int first = CENTRAL_PIECE_NUMBER + dx_[LEFT];
+
+		threshold_ = GetHeuristic(first, LEFT, LEFT);
+		if (threshold_ >= INF)
+			return false;
+
+		while (!Search(CENTRAL_COLUMN + dx_[LEFT], CENTRAL_ROW, LEFT, LEFT, 0)) {
+			if (next_threshold_ >= INF)
+				return false;
+			threshold_ = next_threshold_;
+			next_threshold_ = INF;
+		}
+
+		// convert target orientations into clicks
+		moves.clear();
+		for (int n = 0; n < NUM_PIECES; n++) {
+			if (targets_[n] == -1)
+				continue;
+
+			int current = board_.GetOrientation(n);
+			if (Test(board_.straight_, n)) {
+				if (targets_[n] != current)
+					moves.push_back(Move{ n, true });
+				continue;
+			}
+
+			int clockwise_steps = (targets_[n] - current) & 3;
+#ifndef BUG2BUG
+			if (clockwise_steps == 3) {
+				moves.push_back(Move{ n, false });
+				continue;
+			}
+#endif
+			for (int i = 0; i < clockwise_steps; i++)
+				moves.push_back(Move{ n, true });
+		}
+
+		return true;
+	}
+};
+
+ArtemisBoard::ArtemisBoard(const std::array<PieceType, NUM_PIECES>& pieces) : straight_(0), orientations_{ { 0, 0 } } {
+	for (int n = 0; n < NUM_PIECES; n++) {
+		if (pieces[n] >= HO) {
+			straight_ |= (Mask)1 << n;
+			SetOrientation(n, pieces[n] - HO);
+		} else {
+			SetOrientation(n, pieces[n]);
+		}
+	}
+
+	for (int dir = 0; dir < 4; dir++)
+		StartPath(paths_[dir], (Direction)dir);
+	UpdateConnectivity();
+}
+
+int ArtemisBoard::GetExitSystem(int x, int y) {
+	if (x == -1 && y == CENTRAL_ROW)
+		return AUX_BIO_SYSTEMS;
+	if (x == NUM_COLUMNS && y == CENTRAL_ROW)
+		return AUX_CONTROL_SYSTEM;
+	if (x == CENTRAL_COLUMN && y == -1)
+		return AUX_AIR_REFILTRATION;
+	if (x == CENTRAL_COLUMN && y == NUM_ROWS)
+		return AUX_POWER_GRID;
+	return 0;
+}
+
+int ArtemisBoard::GetOrientation(int n) const {
+	return (orientations_[n / 32] >> (n % 32 * 2)) & 3;
+}
+
+void ArtemisBoard::SetOrientation(int n, int orientation) {
+	uint64_t& word = orientations_[n / 32];
+	int shift = n % 32 * 2;
+	word = (word & ~((uint64_t)3 << shift)) | ((uint64_t)orientation << shift);
+}
+
+ArtemisBoard::PieceType ArtemisBoard::RotatePiece(PieceType type, bool clockwise) {
+	if (type >= HO)
+		return (PieceType)(HO + ((type - HO) ^ 1));
+	return (PieceType)((type + (clockwise ? 1 : 3)) & 3);
+}
+
+ArtemisBoard::PieceType ArtemisBoard::GetPiece(int n) const {
+	int orientation = GetOrientation(n);
+	return Test(straight_, n) ? (PieceType)(HO + orientation) : (PieceType)orientation;
+}
+
+void ArtemisBoard::RotatePiece(int n, bool clockwise) {
+	if (Test(straight_, n))
+		SetOrientation(n, GetOrientation(n) ^ 1);
+	else
+		SetOrientation(n, (GetOrientation(n) + (clockwise ? 1 : 3)) & 3);
+
+	for (auto& path : paths_)
+		RetracePath(path, n);
+	UpdateConnectivity();
+}
+
+void ArtemisBoard::ToggleLine(Connectivity& connectivity, int n, int dir) {
+	// line through which power enters piece n moving in given direction
+	int x = n % NUM_COLUMNS;
+	int y = n / NUM_COLUMNS;
+
+	switch (dir) {
+	case LEFT:  connectivity.horizontal_lines ^= (Mask)1 << (y * (NUM_COLUMNS - 1) + x); break;
+	case RIGHT: connectivity.horizontal_lines ^= (Mask)1 << (y * (NUM_COLUMNS - 1) + x - 1); break;
+	case UP:    connectivity.vertical_lines ^= (Mask)1 << (y * NUM_COLUMNS + x); break;
+	case DOWN:  connectivity.vertical_lines ^= (Mask)1 << ((y - 1) * NUM_COLUMNS + x); break;
+	}
+}
+
+void ArtemisBoard::ExtendPath(Path& path, int x, int y, int dir) const {
+	path.end = -1;
+	path.connectivity.systems = 0;
+
+	while (1) {
+		int prev_dir = dir;
+		x += dx_[dir];
+		y += dy_[dir];
+
+		if (x < 0 || y < 0 || x >= NUM_COLUMNS || y >= NUM_ROWS) {
+			path.connectivity.systems = GetExitSystem(x, y);
+			return; // out of bounds
+		}
+
+		int n = y * NUM_COLUMNS + x;
+		if (n == CENTRAL_PIECE_NUMBER)
+			return; // back into center
+
+		dir = turns_[GetPiece(n)][dir];
+		if (dir == -1) {
+			path.end = n;
+			path.end_dir = prev_dir;
+			return;
+		}
+
+		// activate piece and line from prev piece; a path never
+		// visits the same piece twice, so bits are always unset here
+		path.pieces[path.length] = n;
+		path.dirs[path.length] = prev_dir;
+		path.length++;
+
+		path.connectivity.active |= (Mask)1 << n;
+		ToggleLine(path.connectivity, n, prev_dir);
+	}
+}
+
+void ArtemisBoard::StartPath(Path& path, Direction dir) const {
+	path.length = 0;
+	path.connectivity = Connectivity{ 0, 0, 0, 0 };
+	ExtendPath(path, CENTRAL_COLUMN, CENTRAL_ROW, dir);
+}
+
+void ArtemisBoard::RetracePath(Path& path, int n) const {
+	// path may end at a piece it has already passed through (from
+	// the unconnected side), so check for passing through first
+	int dir;
+	if (Test(path.connectivity.active, n)) {
+		// cut the path at given piece
+		int cut = path.length;
+		while (path.pieces[--cut] != n) {
+		}
+
+		dir = path.dirs[cut];
+
+		for (int i = cut; i < path.length; i++) {
+			path.connectivity.active &= ~((Mask)1 << path.pieces[i]);
+			ToggleLine(path.connectivity, path.pieces[i], path.dirs[i]);
+		}
+		path.length = cut;
+	} else if (path.end == n) {
+		dir = path.end_dir;
+	} else {
+		return; // path is not affected
+	}
+
+	ExtendPath(path, n % NUM_COLUMNS - dx_[dir], n / NUM_COLUMNS - dy_[dir], dir);
+}
+
+void ArtemisBoard::UpdateConnectivity() {
+	// paths may only overlap when one of them returns into the center
+	// along the other one, so union is used for combining them
+	connectivity_ = Connectivity{ 0, 0, 0, 0 };
+	for (const auto& path : paths_) {
+		connectivity_.active |= path.connectivity.active;
+		connectivity_.horizontal_lines |= path.connectivity.horizontal_lines;
+		connectivity_.vertical_lines |= path.connectivity.vertical_lines;
+		connectivity_.systems |= path.connectivity.systems;
+	}
+}
+
+const ArtemisBoard::Connectivity& ArtemisBoard::GetConnectivity() const {
+	return connectivity_;
+}
+
+ArtemisBoard::Connectivity ArtemisBoard::Trace() const {
+	Connectivity result = { 0, 0, 0, 0 };
+
+	Path path;
+	for (int dir = 0; dir < 4; dir++) {
+		StartPath(path, (Direction)dir);
+		result.active |= path.connectivity.active;
+		result.horizontal_lines |= path.connectivity.horizontal_lines;
+		result.vertical_lines |= path.connectivity.vertical_lines;
+		result.systems |= path.connectivity.systems;
+	}
+
+	return result;
+}
+
+bool ArtemisBoard::Solve(std::vector<Move>& moves) const {
+	return Solver(*this).Solve(moves);
+}
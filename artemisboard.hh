@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARTEMISBOARD_HH
+#define ARTEMISBOARD_HH
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Logic of Artemis power grid puzzle, without any presentation
+//
+// Board is a grid of pieces, each connecting two of its sides,
+// with power source in the center. Power flows from the center in
+// all four directions along connected pieces, and the puzzle is
+// solved when it reaches all four systems located outside the
+// board opposite to the center.
+//
+// Rotation never changes piece kind (corner or straight line), so
+// the board is stored as a mask of straight pieces plus 2 bit
+// orientation of each piece, and connectivity is traced with
+// lookup tables.
+//
+// Connectivity is kept up to date on rotation: each of four paths
+// from the center remembers pieces it goes through, so only the
+// paths passing through (or ending at) the rotated piece are cut
+// at that piece and traced further from there.
+class ArtemisBoard {
+public:
+	enum PieceType {
+		DR = 0,
+		DL = 1,
+		UL = 2,
+		UR = 3,
+		HO = 4,
+		VE = 5,
+	};
+
+	enum Direction {
+		LEFT,
+		RIGHT,
+		UP,
+		DOWN,
+	};
+
+	enum Systems {
+		AUX_BIO_SYSTEMS = 1,
+		AUX_CONTROL_SYSTEM = 2,
+		AUX_AIR_REFILTRATION = 4,
+		AUX_POWER_GRID = 8,
+
+		ALL_SYSTEMS = AUX_BIO_SYSTEMS | AUX_CONTROL_SYSTEM | AUX_AIR_REFILTRATION | AUX_POWER_GRID,
+	};
+
+	enum Constants {
+		NUM_COLUMNS = 9,
+		NUM_ROWS = 7,
+
+		NUM_PIECES = NUM_COLUMNS * NUM_ROWS,
+		CENTRAL_PIECE_NUMBER = NUM_PIECES / 2,
+
+		NUM_HORIZONTAL_LINES = (NUM_COLUMNS - 1) * NUM_ROWS,
+		NUM_VERTICAL_LINES = NUM_COLUMNS * (NUM_ROWS - 1),
+
+		CENTRAL_COLUMN = NUM_COLUMNS / 2,
+		CENTRAL_ROW = NUM_ROWS / 2,
+	};
+
+	// bit per piece or per connection line
+	typedef uint64_t Mask;
+
+	// result of tracing power from the center
+	struct Connectivity {
+		Mask active;
+		Mask horizontal_lines;
+		Mask vertical_lines;
+		int systems;
+	};
+
+	// single click on a piece
+	struct Move {
+		int piece;
+		bool clockwise;
+	};
+
+private:
+	class Solver;
+
+	// power path going from the center in one direction
+	struct Path {
+		int length;
+		std::array<signed char, NUM_PIECES> pieces;
+		std::array<signed char, NUM_PIECES> dirs; // direction power enters each piece
+
+		// piece which doesn't accept power, or -1
+		int end;
+		int end_dir;
+
+		Connectivity connectivity;
+	};
+
+public:
+	static const std::array<PieceType, NUM_PIECES> initial_pieces_;
+
+private:
+	static const std::array<std::array<signed char, 4>, 6> turns_;
+	static const std::array<int, 4> dx_;
+	static const std::array<int, 4> dy_;
+
+private:
+	Mask straight_;
+	std::array<uint64_t, 2> orientations_;
+
+	std::array<Path, 4> paths_;
+	Connectivity connectivity_;
+
+private:
+	static int GetExitSystem(int x, int y);
+	static void ToggleLine(Connectivity& connectivity, int n, int dir);
+
+	int GetOrientation(int n) const;
+	void SetOrientation(int n, int orientation);
+
+	void ExtendPath(Path& path, int x, int y, int dir) const;
+	void StartPath(Path& path, Direction dir) const;
+	void RetracePath(Path& path, int n) const;
+	void UpdateConnectivity();
+
+public:
+	ArtemisBoard(const std::array<PieceType, NUM_PIECES>& pieces = initial_pieces_);
+
+	static PieceType RotatePiece(PieceType type, bool clockwise = true);
+
+	PieceType GetPiece(int n) const;
+	void RotatePiece(int n, bool clockwise = true);
+
+	// connectivity of the current board
+	const Connectivity& GetConnectivity() const;
+
+	// connectivity calculated from scratch
+	Connectivity Trace() const;
+
+	// find minimal number of clicks which connect all systems;
+	// returns false if the board cannot be solved
+	bool Solve(std::vector<Move>& moves) const;
+
+	static bool Test(Mask mask, int n) {
+		return (mask >> n) & 1;
+	}
+};
+
+#endif // ARTEMISBOARD_HH
@@ -22,101 +22,70 @@
 
 #include <array>
 
-#include <SDL2pp/Texture.hh>
 #include <SDL2pp/Renderer.hh>
 
+#include "artemisboard.hh"
 #include "screen.hh"
+#include "texturecache.hh"
 
-class DataManager;
+class Clock;
 
 class ArtemisPuzzle : public Screen {
 private:
-	enum PieceType {
-		DR = 0,
-		DL = 1,
-		UL = 2,
-		UR = 3,
-		HO = 4,
-		VE = 5,
-	};
-
-	enum Direction {
-		LEFT,
-		RIGHT,
-		UP,
-		DOWN,
-	};
-
-	enum Systems {
-		AUX_BIO_SYSTEMS = 1,
-		AUX_CONTROL_SYSTEM = 2,
-		AUX_AIR_REFILTRATION = 4,
-		AUX_POWER_GRID = 8,
-
-		ALL_SYSTEMS = AUX_BIO_SYSTEMS | AUX_CONTROL_SYSTEM | AUX_AIR_REFILTRATION | AUX_POWER_GRID,
-	};
-
 	enum Constants {
-		NUM_COLUMNS = 9,
-		NUM_ROWS = 7,
-
-		NUM_PIECES = NUM_COLUMNS * NUM_ROWS,
-		CENTRAL_PIECE_NUMBER = NUM_PIECES / 2,
+		NUM_COLUMNS = ArtemisBoard::NUM_COLUMNS,
+		NUM_ROWS = ArtemisBoard::NUM_ROWS,
 
-		NUM_HORIZONTAL_LINES = (NUM_COLUMNS - 1) * NUM_ROWS,
-		NUM_VERTICAL_LINES = NUM_COLUMNS * (NUM_ROWS - 1),
+		NUM_PIECES = ArtemisBoard::NUM_PIECES,
+		CENTRAL_PIECE_NUMBER = ArtemisBoard::CENTRAL_PIECE_NUMBER,
 
-		CENTRAL_COLUMN = NUM_COLUMNS / 2,
-		CENTRAL_ROW = NUM_ROWS / 2,
+		NUM_HORIZONTAL_LINES = ArtemisBoard::NUM_HORIZONTAL_LINES,
+		NUM_VERTICAL_LINES = ArtemisBoard::NUM_VERTICAL_LINES,
 
 		TIME_LIMIT_TICKS = 280 * 1000,
 	};
 
 private:
-	static const std::array<PieceType, NUM_PIECES> initial_pieces_;
 	static const std::array<int, NUM_COLUMNS> col_offsets_;
 	static const std::array<int, NUM_ROWS> row_offsets_;
 	static const std::array<SDL2pp::Point, 13> light_locations_;
 
 private:
 	SDL2pp::Renderer& renderer_;
+	const Clock& clock_;
 
 	// Textures
-	SDL2pp::Texture background_;
-	SDL2pp::Texture pieces_inactive_;
-	SDL2pp::Texture pieces_active_;
-	SDL2pp::Texture line_horiz_;
-	SDL2pp::Texture line_vert_;
-	SDL2pp::Texture core_;
-	SDL2pp::Texture lights_;
-	SDL2pp::Texture aux1_;
-	SDL2pp::Texture aux2_;
-	SDL2pp::Texture aux3_;
-	SDL2pp::Texture aux4_;
-	SDL2pp::Texture main1_;
-	SDL2pp::Texture main2_;
-	SDL2pp::Texture main3_;
-	SDL2pp::Texture main4_;
-	SDL2pp::Texture greyblit_;
+	TextureCache::TexturePtr background_;
+	TextureCache::TexturePtr pieces_inactive_;
+	TextureCache::TexturePtr pieces_active_;
+	TextureCache::TexturePtr line_horiz_;
+	TextureCache::TexturePtr line_vert_;
+	TextureCache::TexturePtr core_;
+	TextureCache::TexturePtr lights_;
+	TextureCache::TexturePtr aux1_;
+	TextureCache::TexturePtr aux2_;
+	TextureCache::TexturePtr aux3_;
+	TextureCache::TexturePtr aux4_;
+	TextureCache::TexturePtr main1_;
+	TextureCache::TexturePtr main2_;
+	TextureCache::TexturePtr main3_;
+	TextureCache::TexturePtr main4_;
+	TextureCache::TexturePtr greyblit_;
 
 private:
-	std::array<PieceType, NUM_PIECES> pieces_;
-	std::array<bool, NUM_PIECES> active_;
+	ArtemisBoard board_;
 
-	std::array<bool, NUM_HORIZONTAL_LINES> horizontal_lines_;
-	std::array<bool, NUM_VERTICAL_LINES> vertical_lines_;
+	// kept up to date by the board on every rotation
+	const ArtemisBoard::Connectivity& connectivity_;
 
-	int activated_systems_;
 	int time_left_[4];
 	unsigned int last_frame_time_;
 
 private:
-	PieceType RotatePiece(PieceType type, bool clockwise = true);
-	void RecalculateActivePieces();
-	void PropagateActivity(int x, int y, Direction dir);
+	void ApplyHint();
 
 public:
-	ArtemisPuzzle(SDL2pp::Renderer& renderer, const DataManager& datamanager);
+	ArtemisPuzzle(SDL2pp::Renderer& renderer, TextureCache& textures, const Clock& clock);
 	virtual ~ArtemisPuzzle();
 
 	bool ProcessEvent(const SDL_Event& event) override;
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <SDL2/SDL_timer.h>
+
+#include "logger.hh"
+
+#include "clock.hh"
+
+Clock::~Clock() {
+}
+
+uint64_t Clock::Rescale(uint64_t value, uint64_t from, uint64_t to) {
+	// split value so that multiplication only involves remainder,
+	// which is less than from
+	return value / from * to + value % from * to / from;
+}
+
+uint64_t Clock::GetScaledTime(uint64_t timescale) const {
+	return Rescale(GetTime(), GetFrequency(), timescale);
+}
+
+unsigned int Clock::GetTicks() const {
+	return (unsigned int)GetScaledTime(1000);
+}
+
+SystemClock::SystemClock() : start_counter_(SDL_GetPerformanceCounter()), frequency_(SDL_GetPerformanceFrequency()), speed_num_(1), speed_den_(1) {
+}
+
+SystemClock::~SystemClock() {
+}
+
+Clock::Time SystemClock::GetTime() const {
+	return Rescale(SDL_GetPerformanceCounter() - start_counter_, speed_den_, speed_num_);
+}
+
+Clock::Time SystemClock::GetFrequency() const {
+	return frequency_;
+}
+
+void SystemClock::SetSpeed(unsigned int num, unsigned int den) {
+	if (num == 0 || den == 0)
+		throw std::runtime_error("bad clock speed");
+
+	// keep current time continuous across speed change
+	Time counter = SDL_GetPerformanceCounter();
+	Time now = Rescale(counter - start_counter_, speed_den_, speed_num_);
+
+	speed_num_ = num;
+	speed_den_ = den;
+	start_counter_ = counter - Rescale(now, speed_num_, speed_den_);
+}
+
+VirtualClock::VirtualClock(Time frequency) : time_(0), frequency_(frequency) {
+	if (frequency_ == 0)
+		throw std::runtime_error("bad clock frequency");
+}
+
+VirtualClock::~VirtualClock() {
+}
+
+Clock::Time VirtualClock::GetTime() const {
+	return time_;
+}
+
+Clock::Time VirtualClock::GetFrequency() const {
+	return frequency_;
+}
+
+void VirtualClock::SetTime(Time time) {
+	time_ = time;
+}
+
+FrameStats::FrameStats() : start_(WallClock::now()), frames_(0), hitches_(0), max_frame_ms_(0.0) {
+}
+
+FrameStats::~FrameStats() {
+	double total_ms = std::chrono::duration<double, std::milli>(WallClock::now() - start_).count();
+
+	Log(LogCategory::MAIN) << frames_ << " frames in " << total_ms << " ms, avg " << (frames_ ? total_ms / frames_ : 0.0)
+		<< " ms, max " << max_frame_ms_ << " ms, " << hitches_ << " frames over " << (int)HITCH_MS << " ms";
+}
+
+void FrameStats::FrameStart() {
+	frame_start_ = WallClock::now();
+}
+
+void FrameStats::FrameEnd() {
+	double frame_ms = std::chrono::duration<double, std::milli>(WallClock::now() - frame_start_).count();
+
+	frames_++;
+	if (frame_ms > HITCH_MS)
+		hitches_++;
+	max_frame_ms_ = std::max(max_frame_ms_, frame_ms);
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLOCK_HH
+#define CLOCK_HH
+
+#include <chrono>
+#include <cstdint>
+
+// Source of game time since game start
+//
+// All game logic (movie playback, interface delays, puzzle timers)
+// takes time from here rather than from SDL directly, so it may be
+// driven by recorded input instead of wall clock.
+//
+// Time is counted in clock specific units, GetFrequency() of them
+// per second; it should be converted to other time bases with
+// Rescale() only after taking differences, so no precision is lost.
+class Clock {
+public:
+	typedef uint64_t Time;
+
+public:
+	virtual ~Clock();
+
+	virtual Time GetTime() const = 0;
+	virtual Time GetFrequency() const = 0;
+
+	// value * to / from, without intermediate overflow
+	static uint64_t Rescale(uint64_t value, uint64_t from, uint64_t to);
+
+	// time in units of 1/timescale seconds
+	uint64_t GetScaledTime(uint64_t timescale) const;
+
+	// time in milliseconds
+	unsigned int GetTicks() const;
+};
+
+// Wall clock time, based on high resolution counter, optionally
+// running faster or slower than real time
+class SystemClock : public Clock {
+protected:
+	Time start_counter_;
+	Time frequency_;
+
+	// speed factor
+	unsigned int speed_num_;
+	unsigned int speed_den_;
+
+public:
+	SystemClock();
+	virtual ~SystemClock();
+
+	virtual Time GetTime() const override;
+	virtual Time GetFrequency() const override;
+
+	void SetSpeed(unsigned int num, unsigned int den);
+};
+
+// Time which only changes when explicitly told to
+//
+// Game time is kept constant during each frame this way, taken
+// either from wall clock or from recorded input.
+class VirtualClock : public Clock {
+protected:
+	Time time_;
+	Time frequency_;
+
+public:
+	VirtualClock(Time frequency);
+	virtual ~VirtualClock();
+
+	virtual Time GetTime() const override;
+	virtual Time GetFrequency() const override;
+
+	void SetTime(Time time);
+};
+
+// Wall clock duration statistics of main loop iterations, logged
+// on destruction
+class FrameStats {
+protected:
+	typedef std::chrono::steady_clock WallClock;
+
+	enum {
+		HITCH_MS = 50,
+	};
+
+protected:
+	WallClock::time_point start_;
+	WallClock::time_point frame_start_;
+	unsigned long frames_;
+	unsigned long hitches_;
+	double max_frame_ms_;
+
+public:
+	FrameStats();
+	~FrameStats();
+
+	void FrameStart();
+	void FrameEnd();
+};
+
+#endif // CLOCK_HH
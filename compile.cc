@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "filebuffer.hh"
+#include "hotfile.hh"
+#include "nodfile.hh"
+
+void usage(const char* progname) {
+	std::cerr << "Usage: " << progname << " <input .nod or .hot file> <output file>" << std::endl;
+}
+
+int realmain(int argc, char** argv) {
+	const char* progname = argv[0];
+
+	int ch;
+	while ((ch = getopt(argc, argv, "h")) != -1) {
+		switch (ch) {
+		case 'h':
+			usage(progname);
+			return 0;
+		default:
+			usage(progname);
+			return 1;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2) {
+		usage(progname);
+		return 1;
+	}
+
+	std::string input = argv[0];
+	std::transform(input.begin(), input.end(), input.begin(), ::tolower);
+
+	if (input.rfind(".nod") == input.length() - 4) {
+		NodFile(FileBuffer(argv[0])).Save(argv[1]);
+	} else if (input.rfind(".hot") == input.length() - 4) {
+		HotFile(FileBuffer(argv[0])).Save(argv[1]);
+	} else {
+		std::cerr << "Error: unknown file type " << argv[0] << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	try {
+		return realmain(argc, argv);
+	} catch (std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+
+	return 1;
+}
@@ -18,14 +18,79 @@
  */
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include "logger.hh"
+#include "tracer.hh"
+#include "archive.hh"
+#include "isoimage.hh"
+#include "ioscheduler.hh"
+#include "localcache.hh"
 
 #include "datamanager.hh"
 
-void DataManager::ScanDir(const std::string& path, std::function<void(const std::string&, const std::string&)> processor) {
+namespace {
+
+const char* const IndexCacheSignature = "opendaed-index-2";
+
+const size_t RawSectorsPerRead = 64;
+
+// amount of data read from the largest file of each data root to
+// measure its speed
+const size_t SpeedProbeBytes = 4 * 1024 * 1024;
+
+// roots which speeds differ less than this are considered equally
+// fast, so measurement noise doesn't affect the choice
+const double SpeedTolerance = 1.5;
+
+// roots slower than this are treated as optical media, reads
+// from which need to be scheduled
+const double SlowMediaSpeed = 16.0 * 1024 * 1024;
+
+const size_t HashChunkSize = 1024 * 1024;
+
+const size_t ExtractChunkSize = 1024 * 1024;
+
+// total size of extracted archived files kept on disk
+const off_t MaxExtractedBytes = 256 * 1024 * 1024;
+
+// parallel scanner splits data tree into subtrees until there
+// are at least this many subtrees per thread, but doesn't go
+// deeper than given depth
+const int ScanTasksPerThread = 4;
+const int ScanMaxSplitDepth = 3;
+
+inline unsigned char FoldCase(char c) {
+	return ::tolower((unsigned char)c);
+}
+
+// FNV-1a over case folded file name
+inline uint32_t HashName(const char* name, size_t length) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= FoldCase(name[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+}
+
+void DataManager::ScanDir(const std::string& path, const ScanProcessor& processor) {
 	DIR* dirp = opendir(path.c_str());
 	if (dirp == nullptr)
 		throw std::runtime_error("cannot read data directory");
@@ -36,10 +101,18 @@ void DataManager::ScanDir(const std::string& path, std::function<void(const std:
 			if (de->d_name[0] == '.')
 				continue;
 
-			if (de->d_type == DT_DIR) {
-				ScanDir(path + "/" + de->d_name, processor);
-			} else if (de->d_type == DT_REG) {
-				processor(path, de->d_name);
+			std::string fullpath = path + "/" + de->d_name;
+
+			// size and mtime are needed for index cache anyway,
+			// and d_type may be DT_UNKNOWN on some filesystems
+			struct stat st;
+			if (stat(fullpath.c_str(), &st) != 0)
+				continue;
+
+			if (S_ISDIR(st.st_mode)) {
+				ScanDir(fullpath, processor);
+			} else if (S_ISREG(st.st_mode)) {
+				processor(path, de->d_name, st);
 			}
 		}
 	} catch (...) {
@@ -49,59 +122,808 @@ void DataManager::ScanDir(const std::string& path, std::function<void(const std:
 	closedir(dirp);
 }
 
-DataManager::DataManager() {
+void DataManager::ParallelScanDir(const std::string& path, const ScanProcessor& processor) {
+	// Each task is either a single file or a whole subtree, and
+	// tasks are kept in the same order sequential ScanDir() would
+	// visit them, so results merged in task order are identical
+	// to these of sequential scan, including which of the files
+	// with the same name comes first
+	struct ScannedFile {
+		std::string dir;
+		std::string name;
+		struct stat st;
+	};
+
+	struct Task {
+		ScannedFile entry;
+		bool is_dir;
+		std::vector<ScannedFile> files;
+	};
+
+	std::vector<Task> tasks;
+	tasks.push_back({ { path, "", {} }, true, {} });
+
+	// split subtrees until there's enough work for all threads
+	for (int depth = 0; depth < ScanMaxSplitDepth; depth++) {
+		size_t num_dirs = std::count_if(tasks.begin(), tasks.end(), [](const Task& t) { return t.is_dir; });
+		if (num_dirs == 0 || num_dirs >= (size_t)(scan_threads_ * ScanTasksPerThread))
+			break;
+
+		std::vector<Task> new_tasks;
+		for (auto& task : tasks) {
+			if (!task.is_dir) {
+				new_tasks.emplace_back(std::move(task));
+				continue;
+			}
+
+			std::string dirpath = task.entry.name.empty() ? task.entry.dir : task.entry.dir + "/" + task.entry.name;
+			DIR* dirp = opendir(dirpath.c_str());
+			if (dirp == nullptr)
+				throw std::runtime_error("cannot read data directory");
+
+			struct dirent* de;
+			while ((de = readdir(dirp)) != nullptr) {
+				if (de->d_name[0] == '.')
+					continue;
+
+				Task child = { { dirpath, de->d_name, {} }, false, {} };
+				if (stat((dirpath + "/" + de->d_name).c_str(), &child.entry.st) != 0)
+					continue;
+
+				if (S_ISDIR(child.entry.st.st_mode))
+					child.is_dir = true;
+				else if (!S_ISREG(child.entry.st.st_mode))
+					continue;
+
+				new_tasks.emplace_back(std::move(child));
+			}
+			closedir(dirp);
+		}
+
+		tasks.swap(new_tasks);
+	}
+
+	// scan remaining subtrees concurrently
+	std::atomic<size_t> next_task(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	auto worker = [&]() {
+		size_t ntask;
+		while ((ntask = next_task++) < tasks.size()) {
+			Task& task = tasks[ntask];
+			if (!task.is_dir)
+				continue;
+
+			try {
+				std::string dirpath = task.entry.name.empty() ? task.entry.dir : task.entry.dir + "/" + task.entry.name;
+				ScanDir(dirpath, [&task](const std::string& dir, const std::string& file, const struct stat& st) {
+						task.files.push_back({ dir, file, st });
+					});
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < scan_threads_; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+
+	// merge results in order
+	for (auto& task : tasks) {
+		if (task.is_dir) {
+			for (auto& file : task.files)
+				processor(file.dir, file.name, file.st);
+		} else {
+			processor(task.entry.dir, task.entry.name, task.entry.st);
+		}
+	}
+}
+
+void DataManager::LoadIndexCache() {
+	index_cache_loaded_ = true;
+
+	std::ifstream stream(index_cache_path_, std::ios_base::in);
+	if (!stream.is_open())
+		return;
+
+	std::string line;
+	std::getline(stream, line);
+	if (stream.fail() || line != IndexCacheSignature)
+		return;
+
+	// sections start with a line containing mtime and path of data
+	// root, preceded by a tab; entries are lowercase name, size,
+	// mtime, full path, separated by tabs, as names may contain
+	// spaces
+	IndexCache new_cache;
+	CachedRoot* root = nullptr;
+	while (std::getline(stream, line)) {
+		if (!line.empty() && line[0] == '\t') {
+			size_t pathpos = line.find('\t', 1);
+			if (pathpos == std::string::npos)
+				return;
+
+			CachedRoot new_root;
+			try {
+				new_root.mtime = std::stoll(line.substr(1, pathpos - 1));
+			} catch (std::logic_error&) {
+				return;
+			}
+
+			root = &(new_cache[line.substr(pathpos + 1)] = new_root);
+			continue;
+		}
+
+		size_t sizepos = line.find('\t');
+		size_t mtimepos = line.find('\t', sizepos + 1);
+		size_t pathpos = line.find('\t', mtimepos + 1);
+		if (root == nullptr || sizepos == std::string::npos || mtimepos == std::string::npos || pathpos == std::string::npos)
+			return;
+
+		FileInfo info;
+		info.offset = 0;
+		info.archived = false;
+		info.sector_size = info.sector_data_offset = 0;
+		info.root = 0;
+		try {
+			info.size = std::stoll(line.substr(sizepos + 1, mtimepos - sizepos - 1));
+			info.mtime = std::stoll(line.substr(mtimepos + 1, pathpos - mtimepos - 1));
+		} catch (std::logic_error&) {
+			return;
+		}
+		info.name = line.substr(0, sizepos);
+		info.path = line.substr(pathpos + 1);
+
+		root->files.insert(std::make_pair(info.name, info));
+	}
+
+	index_cache_.swap(new_cache);
+}
+
+void DataManager::SaveIndexCache() const {
+	std::string tmppath = index_cache_path_ + ".tmp";
+
+	{
+		std::ofstream stream(tmppath, std::ios_base::out | std::ios_base::trunc);
+		if (!stream.is_open()) {
+			Log(LogCategory::DATAMGR, LogLevel::WARNING) << "cannot write index cache " << index_cache_path_;
+			return;
+		}
+
+		stream << IndexCacheSignature << "\n";
+		for (auto& root : index_cache_) {
+			stream << "\t" << root.second.mtime << "\t" << root.first << "\n";
+			for (auto& file: root.second.files)
+				stream << file.first << "\t" << file.second.size << "\t" << file.second.mtime << "\t" << file.second.path << "\n";
+		}
+
+		if (stream.fail()) {
+			Log(LogCategory::DATAMGR, LogLevel::WARNING) << "cannot write index cache " << index_cache_path_;
+			return;
+		}
+	}
+
+	// replace atomically so interrupted write never leaves broken cache
+	if (rename(tmppath.c_str(), index_cache_path_.c_str()) != 0)
+		Log(LogCategory::DATAMGR, LogLevel::WARNING) << "cannot write index cache " << index_cache_path_;
+}
+
+DataManager::DataManager() : force_rescan_(false), index_cache_loaded_(false), scan_threads_(std::max(1u, std::thread::hardware_concurrency())), probe_speed_(false), verify_duplicates_(false), io_scheduler_(nullptr), local_cache_(nullptr), extracted_bytes_(0), extract_clock_(0), pinned_file_(INVALID_FILE_ID) {
 }
 
 DataManager::~DataManager() {
+	for (auto& file : extracted_files_)
+		if (file.second.state == EXTRACTED)
+			unlink(file.second.path.c_str());
+	if (!extract_dir_.empty())
+		rmdir(extract_dir_.c_str());
+}
+
+void DataManager::SetIndexCache(const std::string& path, bool force_rescan) {
+	index_cache_path_ = path;
+	force_rescan_ = force_rescan;
+}
+
+void DataManager::SetScanThreads(int threads) {
+	scan_threads_ = std::max(1, threads);
+}
+
+void DataManager::SetProbeSpeed(bool probe) {
+	probe_speed_ = probe;
+}
+
+void DataManager::SetVerifyDuplicates(bool verify) {
+	verify_duplicates_ = verify;
+}
+
+void DataManager::SetIoScheduler(IoScheduler* io_scheduler) {
+	io_scheduler_ = io_scheduler;
+}
+
+void DataManager::SetLocalCache(LocalCache* local_cache) {
+	local_cache_ = local_cache;
+}
+
+void DataManager::ScanDir(const std::string& datapath, int priority) {
+	TraceSpan span("datamgr", "scan", datapath);
+
+	FileMap new_files;
+
+	// Note: cached index is only validated against mtime of data
+	// directory itself, which is enough for CD-ROMs and read-only
+	// installations; if contents of subdirectories is changed,
+	// rescan should be forced
+	struct stat st;
+	if (stat(datapath.c_str(), &st) != 0)
+		throw std::runtime_error("cannot read data directory");
+
+	if (!index_cache_path_.empty() && !index_cache_loaded_)
+		LoadIndexCache();
+
+	IndexCache::const_iterator cached = index_cache_.find(datapath);
+
+	if (S_ISREG(st.st_mode)) {
+		// data path may also point to disc image or data archive,
+		// see isoimage.hh and archive.hh
+		if (!ScanDiscImage(datapath, new_files))
+			ScanArchive(datapath, new_files);
+	} else if (!index_cache_path_.empty() && !force_rescan_ && cached != index_cache_.end() && cached->second.mtime == st.st_mtime) {
+		Log(LogCategory::DATAMGR) << "using cached index " << index_cache_path_ << " for " << datapath;
+		new_files = cached->second.files;
+	} else {
+		// Note: for the sake of simplicity, we assume that file
+		// with specific name is only present on a single disk once
+		// and if it's present on different disks, all copies are
+		// identical
+		ScanProcessor processor = [&new_files](const std::string& dir, const std::string& file, const struct stat& st){
+				std::string lcfile = file;
+				std::transform(lcfile.begin(), lcfile.end(), lcfile.begin(), ::tolower);
+				new_files.insert(std::make_pair(lcfile, FileInfo{ lcfile, dir + "/" + file, st.st_size, st.st_mtime, 0, false, 0, 0, 0 }));
+			};
+
+		if (scan_threads_ > 1)
+			ParallelScanDir(datapath, processor);
+		else
+			ScanDir(datapath, processor);
+
+		if (!index_cache_path_.empty()) {
+			index_cache_[datapath] = CachedRoot{ st.st_mtime, new_files };
+			SaveIndexCache();
+		}
+	}
+
+	size_t root_files = new_files.size();
+
+	int root = roots_.size();
+	for (auto& file : new_files)
+		file.second.root = root;
+
+	double speed = probe_speed_ ? ProbeSpeed(new_files) : 0.0;
+	roots_.push_back(Root{ datapath, priority, speed, speed > 0.0 && speed < SlowMediaSpeed });
+
+	if (probe_speed_)
+		Log(LogCategory::DATAMGR) << "read speed of " << datapath << " is " << roots_.back().speed / 1024.0 / 1024.0 << " MiB/s";
+
+	// merge with files from previously added roots
+	std::vector<Duplicate> duplicates;
+	for (auto& file : files_) {
+		auto inserted = new_files.insert(std::make_pair(file.name, file));
+		if (inserted.second)
+			continue;
+
+		FileInfo& candidate = inserted.first->second;
+		if (IsPreferred(file, candidate)) {
+			duplicates.push_back(Duplicate{ &candidate, candidate });
+			candidate = file;
+		} else {
+			duplicates.push_back(Duplicate{ &candidate, file });
+		}
+	}
+
+	if (verify_duplicates_)
+		VerifyDuplicates(duplicates);
+
+	BuildIndex(new_files);
+
+	Log(LogCategory::DATAMGR) << "found " << root_files << " data files in " << datapath << ", " << files_.size() << " total";
+}
+
+double DataManager::ProbeSpeed(const FileMap& files) const {
+	// larger file is more likely to be stored contiguously on
+	// disc, so seek time doesn't distort the result much
+	const FileInfo* largest = nullptr;
+	for (auto& file : files)
+		if (largest == nullptr || file.second.size > largest->size)
+			largest = &file.second;
+
+	if (largest == nullptr || largest->size == 0)
+		return 0.0;
+
+	// try to make sure data is actually read from the media
+	int fd = open(largest->path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return 0.0;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+
+	std::vector<char> buffer(std::min(SpeedProbeBytes, (size_t)largest->size));
+
+	auto start = std::chrono::steady_clock::now();
+	ssize_t nread = Read(*largest, 0, buffer.size(), buffer.data(), IoScheduler::Priority::PLAYBACK);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (nread <= 0 || seconds <= 0.0)
+		return 0.0;
+
+	return nread / seconds;
+}
+
+bool DataManager::IsPreferred(const FileInfo& a, const FileInfo& b) const {
+	const Root& aroot = roots_[a.root];
+	const Root& broot = roots_[b.root];
+
+	if (aroot.priority != broot.priority)
+		return aroot.priority > broot.priority;
+	if (aroot.speed > broot.speed * SpeedTolerance)
+		return true;
+	if (broot.speed > aroot.speed * SpeedTolerance)
+		return false;
+	return a.root < b.root;
+}
+
+bool DataManager::HashFile(const FileInfo& info, uint64_t& hash) const {
+	std::vector<char> buffer(std::min(HashChunkSize, (size_t)info.size));
+
+	// FNV-1a
+	hash = 14695981039346656037ull;
+	for (off_t offset = 0; offset < info.size; ) {
+		ssize_t nread = Read(info, offset, buffer.size(), buffer.data(), IoScheduler::Priority::PLAYBACK);
+		if (nread <= 0)
+			return false;
+
+		for (ssize_t i = 0; i < nread; i++) {
+			hash ^= (unsigned char)buffer[i];
+			hash *= 1099511628211ull;
+		}
+
+		offset += nread;
+	}
+
+	return true;
+}
+
+void DataManager::VerifyDuplicates(std::vector<Duplicate>& duplicates) const {
+	std::vector<char> mismatch(duplicates.size(), false);
+
+	std::atomic<size_t> next_duplicate(0);
+
+	// different roots are usually different devices, so hashing
+	// both copies in parallel keeps all of them busy
+	auto worker = [&]() {
+		size_t nduplicate;
+		while ((nduplicate = next_duplicate++) < duplicates.size()) {
+			const FileInfo& chosen = *duplicates[nduplicate].chosen;
+			const FileInfo& other = duplicates[nduplicate].other;
+
+			uint64_t chosen_hash, other_hash;
+			if (chosen.size != other.size || !HashFile(chosen, chosen_hash) || !HashFile(other, other_hash) || chosen_hash != other_hash)
+				mismatch[nduplicate] = true;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < scan_threads_; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+
+	for (size_t i = 0; i < duplicates.size(); i++) {
+		if (!mismatch[i])
+			continue;
+
+		// copies differ, so speed doesn't matter: use the one
+		// from the root specified first
+		FileInfo& chosen = *duplicates[i].chosen;
+		FileInfo& other = duplicates[i].other;
+		if (other.root < chosen.root)
+			std::swap(chosen, other);
+
+		Log(LogCategory::DATAMGR, LogLevel::WARNING) << "copies of " << chosen.name << " in " << roots_[chosen.root].path << " and " << roots_[other.root].path << " differ, using the former";
+	}
+}
+
+void DataManager::ScanArchive(const std::string& path, FileMap& files) const {
+	// archive index is already deduplicated by packer
+	for (auto& entry : Archive::ReadIndex(path))
+		files.insert(std::make_pair(entry.name, FileInfo{ entry.name, path, (off_t)entry.size, (time_t)entry.mtime, (off_t)entry.offset, true, 0, 0, 0 }));
+}
+
+bool DataManager::ScanDiscImage(const std::string& path, FileMap& files) const {
+	IsoImage::Layout layout;
+	if (!IsoImage::Detect(path, layout))
+		return false;
+
+	// plain images are handled the same way as archives; data in
+	// raw images is interleaved with sector headers, see Read()
+	bool raw = layout.sector_size != IsoImage::SECTOR_DATA_SIZE;
+
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		throw std::runtime_error("cannot stat disc image");
+
+	for (auto& entry : IsoImage::ReadIndex(path, layout)) {
+		off_t offset = (off_t)entry.sector * layout.sector_size + (raw ? 0 : layout.sector_data_offset);
+
+		// truncated image: reads would fail much later, mid-game
+		off_t end = raw
+			? offset + (off_t)((entry.size + IsoImage::SECTOR_DATA_SIZE - 1) / IsoImage::SECTOR_DATA_SIZE) * layout.sector_size
+			: offset + (off_t)entry.size;
+		if (end > st.st_size)
+			throw std::runtime_error("disc image entry is out of image bounds");
+
+		files.insert(std::make_pair(entry.name, FileInfo{ entry.name, path, (off_t)entry.size, (time_t)entry.mtime, offset, true, raw ? layout.sector_size : 0, raw ? layout.sector_data_offset : 0, 0 }));
+	}
+
+	return true;
+}
+
+bool DataManager::IsOnSlowMedia(const FileInfo& info) const {
+	// root is not registered yet while its speed is being probed
+	return info.sector_size != 0 || (info.root < (int)roots_.size() && roots_[info.root].slow);
+}
+
+ssize_t DataManager::ReadContiguous(const FileInfo& info, off_t offset, size_t length, char* buffer, IoScheduler::Priority priority) const {
+	const std::string& path = info.path;
+
+	if (io_scheduler_ != nullptr && IsOnSlowMedia(info))
+		return io_scheduler_->Read(path, offset, length, buffer, priority);
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	size_t total = 0;
+	while (total < length) {
+		ssize_t nread = pread(fd, buffer + total, length - total, offset + total);
+		if (nread <= 0)
+			break;
+		total += nread;
+	}
+
+	close(fd);
+
+	return total;
+}
+
+bool DataManager::Extract(FileId id, IoScheduler::Priority priority, const std::function<bool()>& cancelled) const {
+	const FileInfo& info = GetFileInfo(id);
+
+	std::unique_lock<std::mutex> lock(extract_mutex_);
+
+	if (extract_dir_.empty()) {
+		const char* tmpdir = getenv("TMPDIR");
+		std::string pattern = std::string(tmpdir ? tmpdir : "/tmp") + "/opendaed.XXXXXX";
+		if (mkdtemp(&pattern[0]) == nullptr)
+			throw std::runtime_error("cannot create directory for extracted data files");
+		extract_dir_ = pattern;
+	}
+
+	auto inserted = extracted_files_.insert(std::make_pair(id, ExtractedFile{ extract_dir_ + "/" + info.name, NOT_EXTRACTED, priority, 0 }));
+	ExtractedFile& file = inserted.first->second;
+
+	// being extracted by another thread: make it hurry if needed
+	// and wait for it
+	while (file.state == EXTRACTING) {
+		if (priority < file.priority)
+			file.priority = priority;
+		extract_cv_.wait(lock);
+	}
+
+	if (file.state == EXTRACTED) {
+		file.last_use = ++extract_clock_;
+		return true;
+	}
+
+	file.state = EXTRACTING;
+	file.priority = priority;
+
+	lock.unlock();
+
+	LOG(LogCategory::DATAMGR, LogLevel::DEBUG) << "extracting " << info.name << " from " << info.path;
+
+	TraceSpan span("datamgr", "extract", info.name);
+
+	// data goes through Read(), so it's scheduled like any other
+	// read when the scheduler is set
+	std::string tmppath = file.path + ".part";
+	int fd = open(tmppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	std::vector<char> buffer(std::min(ExtractChunkSize, (size_t)info.size));
+	off_t extracted = 0;
+	bool ok = fd != -1;
+	while (ok && extracted < info.size) {
+		{
+			std::lock_guard<std::mutex> chunk_lock(extract_mutex_);
+			priority = file.priority;
+		}
+
+		if (priority != IoScheduler::Priority::PLAYBACK && cancelled && cancelled()) {
+			ok = false;
+			break;
+		}
+
+		ssize_t nread = Read(id, extracted, buffer.size(), buffer.data(), priority);
+		if (nread <= 0) {
+			ok = false;
+			break;
+		}
+
+		for (ssize_t written = 0; ok && written < nread; ) {
+			ssize_t nwritten = write(fd, buffer.data() + written, nread - written);
+			if (nwritten <= 0)
+				ok = false;
+			else
+				written += nwritten;
+		}
+
+		extracted += nread;
+	}
+
+	if (fd != -1 && close(fd) != 0)
+		ok = false;
+
+	if (ok && rename(tmppath.c_str(), file.path.c_str()) != 0)
+		ok = false;
+
+	if (!ok)
+		unlink(tmppath.c_str());
+
+	lock.lock();
+
+	if (ok) {
+		file.state = EXTRACTED;
+		file.last_use = ++extract_clock_;
+		extracted_bytes_ += info.size;
+		EvictExtracted();
+	} else {
+		file.state = NOT_EXTRACTED;
+	}
+
+	extract_cv_.notify_all();
+
+	return ok;
+}
+
+bool DataManager::IsExtracted(FileId id) const {
+	std::lock_guard<std::mutex> lock(extract_mutex_);
+
+	auto file = extracted_files_.find(id);
+	return file != extracted_files_.end() && file->second.state == EXTRACTED;
 }
 
-void DataManager::ScanDir(const std::string& datapath) {
-	PathMap new_files;
+void DataManager::EvictExtracted() const {
+	// the pinned file is never evicted, and neither is the most
+	// recently used one, as it has just been asked for
+	while (extracted_bytes_ > MaxExtractedBytes) {
+		std::map<FileId, ExtractedFile>::iterator oldest = extracted_files_.end(), newest = extracted_files_.end();
+		for (auto file = extracted_files_.begin(); file != extracted_files_.end(); file++) {
+			if (file->second.state != EXTRACTED)
+				continue;
+			if (file->first != pinned_file_ && (oldest == extracted_files_.end() || file->second.last_use < oldest->second.last_use))
+				oldest = file;
+			if (newest == extracted_files_.end() || file->second.last_use > newest->second.last_use)
+				newest = file;
+		}
 
-	// Note: for the sake of simplicity, we assume that file
-	// with specific name is only present on a single disk once
-	// and if it's present on different disks, all copies are
-	// identical
-	ScanDir(datapath, [&new_files](const std::string& dir, const std::string& file){
-			std::string fullpath = dir + "/" + file;
-			std::string lcfile = file;
-			std::transform(lcfile.begin(), lcfile.end(), lcfile.begin(), ::tolower);
-			new_files.insert(std::make_pair(lcfile, fullpath));
-		});
+		if (oldest == extracted_files_.end() || oldest == newest)
+			break;
 
-	data_files_.swap(new_files);
+		LOG(LogCategory::DATAMGR, LogLevel::DEBUG) << "evicting extracted " << files_[oldest->first].name;
 
-	Log("datamgr") << "found data files in " << datapath << ":";
-	for (auto& file: data_files_)
-		Log("datamgr") << "  " << file.first << " -> " << file.second;
+		// consumer which still has it open keeps reading it fine
+		unlink(oldest->second.path.c_str());
+		oldest->second.state = NOT_EXTRACTED;
+		extracted_bytes_ -= files_[oldest->first].size;
+	}
 }
 
-std::string DataManager::GetPath(const std::string& path) const {
+const std::string& DataManager::ExtractFile(FileId id) const {
+	// another thread may evict the file before the lock is taken
+	// again, in which case it has to be extracted once more
+	while (true) {
+		if (!Extract(id, IoScheduler::Priority::PLAYBACK, nullptr))
+			throw std::runtime_error("cannot extract data file");
+
+		std::lock_guard<std::mutex> lock(extract_mutex_);
+		ExtractedFile& file = extracted_files_[id];
+		if (file.state != EXTRACTED)
+			continue;
+
+		// previously pinned file, if any, is no longer needed: the
+		// player has either opened it already or moved on
+		pinned_file_ = id;
+		return file.path;
+	}
+}
+
+void DataManager::BuildIndex(FileMap& files) {
+	std::vector<FileInfo> new_files;
+	new_files.reserve(files.size());
+	for (auto& file : files)
+		new_files.emplace_back(std::move(file.second));
+
+	// keep load factor at most 1/2
+	size_t table_size = 16;
+	while (table_size < new_files.size() * 2)
+		table_size *= 2;
+
+	std::vector<FileId> new_hash_table(table_size, INVALID_FILE_ID);
+	for (FileId id = 0; id < (FileId)new_files.size(); id++) {
+		size_t slot = HashName(new_files[id].name.data(), new_files[id].name.length()) & (table_size - 1);
+		while (new_hash_table[slot] != INVALID_FILE_ID)
+			slot = (slot + 1) & (table_size - 1);
+		new_hash_table[slot] = id;
+	}
+
+	files_.swap(new_files);
+	hash_table_.swap(new_hash_table);
+}
+
+DataManager::FileId DataManager::Lookup(const char* name, size_t length) const {
+	if (hash_table_.empty())
+		return INVALID_FILE_ID;
+
+	size_t mask = hash_table_.size() - 1;
+	for (size_t slot = HashName(name, length) & mask; hash_table_[slot] != INVALID_FILE_ID; slot = (slot + 1) & mask) {
+		const std::string& candidate = files_[hash_table_[slot]].name;
+		if (candidate.length() != length)
+			continue;
+
+		size_t i = 0;
+		while (i < length && FoldCase(name[i]) == (unsigned char)candidate[i])
+			i++;
+
+		if (i == length)
+			return hash_table_[slot];
+	}
+
+	return INVALID_FILE_ID;
+}
+
+DataManager::FileId DataManager::Lookup(const char* path) const {
 	// Though full path may be provided (e.g. "images/intrface.bmp",
 	// only file name matters, see assumption described in ScanDir()
-	std::string name = path;
-	size_t slashpos = name.rfind('/');
-	if (slashpos != std::string::npos)
-		name = name.substr(slashpos + 1);
-	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-
-	PathMap::const_iterator file = data_files_.find(name);
-	if (file == data_files_.end())
+	const char* name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+	return Lookup(name, strlen(name));
+}
+
+DataManager::FileId DataManager::Lookup(const std::string& path) const {
+	size_t slashpos = path.rfind('/');
+	size_t namepos = (slashpos == std::string::npos) ? 0 : slashpos + 1;
+	return Lookup(path.data() + namepos, path.length() - namepos);
+}
+
+const DataManager::FileInfo& DataManager::GetFileInfo(FileId id) const {
+	if (id < 0 || id >= (FileId)files_.size())
 		throw std::runtime_error("required data file not found");
 
-	Log("datamgr") << "returning " << file->second << " for " << path;
-	return file->second;
+	return files_[id];
+}
+
+const std::string& DataManager::GetPath(FileId id) const {
+	if (id < 0 || id >= (FileId)files_.size())
+		throw std::runtime_error("required data file not found");
+
+	const FileInfo& info = files_[id];
+
+	if (local_cache_ != nullptr) {
+		if (info.archived)
+			return local_cache_->Materialize(id, info);
+		if (const std::string* local = local_cache_->GetLocalPath(id, info, IoScheduler::Priority::PREFETCH))
+			return *local;
+	}
+
+	if (info.archived)
+		return ExtractFile(id);
+
+	return info.path;
+}
+
+FileBuffer DataManager::Load(FileId id, IoScheduler::Priority priority) const {
+	if (id < 0 || id >= (FileId)files_.size())
+		throw std::runtime_error("required data file not found");
+
+	const FileInfo& info = files_[id];
+
+	TraceSpan span("datamgr", "load", info.name);
+
+	if (local_cache_ != nullptr)
+		if (const std::string* local = local_cache_->GetLocalPath(id, info, IoScheduler::Priority::PREFETCH))
+			return FileBuffer(*local);
+
+	// raw images can't be mapped, and slow media are better read
+	// as a whole by the scheduler than paged in on demand
+	if (info.sector_size != 0 || (io_scheduler_ != nullptr && IsOnSlowMedia(info))) {
+		std::vector<char> data(info.size);
+		if (Read(id, 0, info.size, data.data(), priority) != (ssize_t)info.size)
+			throw std::runtime_error("cannot read data file");
+		return FileBuffer(std::move(data));
+	}
+
+	if (info.archived)
+		return FileBuffer(info.path, info.offset, info.size);
+	else
+		return FileBuffer(info.path);
+}
+
+ssize_t DataManager::Read(FileId id, off_t offset, size_t length, char* buffer, IoScheduler::Priority priority) const {
+	return Read(GetFileInfo(id), offset, length, buffer, priority);
+}
+
+ssize_t DataManager::Read(const FileInfo& info, off_t offset, size_t length, char* buffer, IoScheduler::Priority priority) const {
+
+	if (offset >= info.size)
+		return 0;
+	length = std::min(length, (size_t)(info.size - offset));
+
+	if (info.sector_size == 0)
+		return ReadContiguous(info, info.offset + offset, length, buffer, priority);
+
+	// raw disc image: read a batch of whole sectors, then pick
+	// user data from each
+	std::vector<char> sectors((size_t)info.sector_size * RawSectorsPerRead);
+
+	size_t total = 0;
+	while (total < length) {
+		off_t first_sector = (offset + total) / IsoImage::SECTOR_DATA_SIZE;
+		size_t skip = (offset + total) % IsoImage::SECTOR_DATA_SIZE;
+		size_t num_sectors = std::min<size_t>((skip + length - total + IsoImage::SECTOR_DATA_SIZE - 1) / IsoImage::SECTOR_DATA_SIZE, RawSectorsPerRead);
+
+		ssize_t nread = ReadContiguous(info, info.offset + first_sector * info.sector_size, num_sectors * info.sector_size, sectors.data(), priority);
+		if (nread != (ssize_t)(num_sectors * info.sector_size))
+			return -1;
+
+		for (size_t sector = 0; sector < num_sectors && total < length; sector++) {
+			size_t chunk = std::min(length - total, IsoImage::SECTOR_DATA_SIZE - skip);
+			memcpy(buffer + total, sectors.data() + sector * info.sector_size + info.sector_data_offset + skip, chunk);
+			total += chunk;
+			skip = 0;
+		}
+	}
+
+	return total;
+}
+
+const std::string& DataManager::GetPath(const std::string& path) const {
+	FileId id = Lookup(path);
+	if (id == INVALID_FILE_ID)
+		throw std::runtime_error("required data file not found");
+
+	LOG(LogCategory::DATAMGR, LogLevel::DEBUG) << "returning " << files_[id].path << " for " << path;
+	return GetPath(id);
+}
+
+FileBuffer DataManager::Load(const std::string& path, IoScheduler::Priority priority) const {
+	FileId id = Lookup(path);
+	if (id == INVALID_FILE_ID)
+		throw std::runtime_error("required data file not found");
+
+	LOG(LogCategory::DATAMGR, LogLevel::DEBUG) << "loading " << files_[id].name << " from " << files_[id].path;
+	return Load(id, priority);
 }
 
 bool DataManager::HasPath(const std::string& path) const {
-	// Though full path may be provided (e.g. "images/intrface.bmp",
-	// only file name matters, see assumption described in ScanDir()
-	std::string name = path;
-	size_t slashpos = name.rfind('/');
-	if (slashpos != std::string::npos)
-		name = name.substr(slashpos + 1);
-	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-
-	PathMap::const_iterator file = data_files_.find(name);
-	return file != data_files_.end();
+	return Lookup(path) != INVALID_FILE_ID;
 }
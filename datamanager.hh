@@ -20,27 +20,204 @@
 #ifndef DATAMANAGER_HH
 #define DATAMANAGER_HH
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdint>
 #include <string>
 #include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 #include <functional>
 
+#include "filebuffer.hh"
+#include "ioscheduler.hh"
+
+class LocalCache;
+
 class DataManager {
+public:
+	typedef int FileId;
+
+	enum {
+		INVALID_FILE_ID = -1,
+	};
+
+	struct FileInfo {
+		std::string name; // lower-cased file name
+		std::string path; // path to the file itself or to archive or disc image containing it
+		off_t size;
+		time_t mtime;
+		off_t offset; // offset of data in archive or disc image
+		bool archived;
+
+		// for raw disc images, data is split into sectors with
+		// only part of each sector containing the data
+		int sector_size; // 0 if data is contiguous
+		int sector_data_offset;
+
+		int root; // index of data root the file was found in
+	};
+
 protected:
-	typedef std::map<std::string, std::string> PathMap;
+	typedef std::map<std::string, FileInfo> FileMap;
+
+	typedef std::function<void(const std::string&, const std::string&, const struct stat&)> ScanProcessor;
+
+	struct CachedRoot {
+		time_t mtime;
+		FileMap files;
+	};
+
+	typedef std::map<std::string, CachedRoot> IndexCache;
+
+	struct Root {
+		std::string path;
+		int priority;
+		double speed; // bytes per second, 0 if not measured
+		bool slow; // measured speed is that of optical media
+	};
+
+	// same file found in more than one root
+	struct Duplicate {
+		FileInfo* chosen;
+		FileInfo other;
+	};
+
+	enum ExtractState {
+		NOT_EXTRACTED,
+		EXTRACTING,
+		EXTRACTED,
+	};
+
+	struct ExtractedFile {
+		std::string path;
+		ExtractState state;
+		IoScheduler::Priority priority; // raised if someone waits for it
+		unsigned long last_use;
+	};
 
 protected:
-	PathMap data_files_;
+	// interned file names: FileId is an index in files_, and
+	// hash_table_ is open addressing table of FileIds keyed by
+	// hash of the (lower-cased) name
+	std::vector<FileInfo> files_;
+	std::vector<FileId> hash_table_;
+
+	std::string index_cache_path_;
+	bool force_rescan_;
+
+	// contents of index cache file, by data root
+	IndexCache index_cache_;
+	bool index_cache_loaded_;
+
+	int scan_threads_;
+
+	std::vector<Root> roots_;
+	bool probe_speed_;
+	bool verify_duplicates_;
+
+	IoScheduler* io_scheduler_;
+	LocalCache* local_cache_;
+
+	// archived files extracted for consumers which require real
+	// files (such as libquicktime); entries are never removed, so
+	// paths stay valid, but least recently used files are deleted
+	// when total size exceeds the limit
+	mutable std::mutex extract_mutex_;
+	mutable std::condition_variable extract_cv_;
+	mutable std::string extract_dir_;
+	mutable std::map<FileId, ExtractedFile> extracted_files_;
+	mutable off_t extracted_bytes_;
+	mutable unsigned long extract_clock_;
+
+	// file last handed out by GetPath(); the player opens it some
+	// time later, so it's not deleted until the next one is
+	mutable FileId pinned_file_;
 
 private:
-	void ScanDir(const std::string& path, std::function<void(const std::string&, const std::string&)> processor);
+	void ScanDir(const std::string& path, const ScanProcessor& processor);
+	void ParallelScanDir(const std::string& path, const ScanProcessor& processor);
+
+	void LoadIndexCache();
+	void SaveIndexCache() const;
+
+	void ScanArchive(const std::string& path, FileMap& files) const;
+	bool ScanDiscImage(const std::string& path, FileMap& files) const;
+	bool IsOnSlowMedia(const FileInfo& info) const;
+	ssize_t ReadContiguous(const FileInfo& info, off_t offset, size_t length, char* buffer, IoScheduler::Priority priority) const;
+	ssize_t Read(const FileInfo& info, off_t offset, size_t length, char* buffer, IoScheduler::Priority priority) const;
+
+	double ProbeSpeed(const FileMap& files) const;
+	bool IsPreferred(const FileInfo& a, const FileInfo& b) const;
+	bool HashFile(const FileInfo& info, uint64_t& hash) const;
+	void VerifyDuplicates(std::vector<Duplicate>& duplicates) const;
+	const std::string& ExtractFile(FileId id) const;
+	void EvictExtracted() const;
+
+	void BuildIndex(FileMap& files);
+	FileId Lookup(const char* name, size_t length) const;
 
 public:
 	DataManager();
 	~DataManager();
 
-	void ScanDir(const std::string& datapath);
-	std::string GetPath(const std::string& path) const;
+	void SetIndexCache(const std::string& path, bool force_rescan = false);
+	void SetScanThreads(int threads);
+
+	// if set, files on slow media (raw disc images, and data roots
+	// which SetProbeSpeed() found to be slow) are read through the
+	// scheduler; the rest is still mapped directly
+	void SetIoScheduler(IoScheduler* io_scheduler);
+
+	// if set, files are used from local cache when available,
+	// and are copied there on first use otherwise
+	void SetLocalCache(LocalCache* local_cache);
+
+	// measure read speed of each data root and prefer files from
+	// faster ones
+	void SetProbeSpeed(bool probe);
+
+	// check that copies of the same file in different data roots
+	// are identical; if they're not, the one from the root added
+	// first is used
+	void SetVerifyDuplicates(bool verify);
+
+	// may be called multiple times to add more data roots; if
+	// the same file is present in multiple roots, the one from
+	// the root with higher priority, then with higher measured
+	// speed, then the one added first is used
+	void ScanDir(const std::string& datapath, int priority = 0);
+
+	// interned lookups; these never allocate memory
+	FileId Lookup(const char* path) const;
+	FileId Lookup(const std::string& path) const;
+	const FileInfo& GetFileInfo(FileId id) const;
+	const std::string& GetPath(FileId id) const;
+	FileBuffer Load(FileId id, IoScheduler::Priority priority = IoScheduler::Priority::PLAYBACK) const;
+
+	// extract archived file in advance, so GetPath() doesn't have to
+	// wait for it; cancelled is checked between chunks unless
+	// someone waits for the file; returns false if extraction
+	// failed or was cancelled
+	bool Extract(FileId id, IoScheduler::Priority priority, const std::function<bool()>& cancelled) const;
+	bool IsExtracted(FileId id) const;
+
+	// reads part of file data, wherever it's stored; goes through
+	// I/O scheduler if it's set; returns number of bytes read or
+	// -1 on error
+	ssize_t Read(FileId id, off_t offset, size_t length, char* buffer, IoScheduler::Priority priority) const;
+
+	const std::string& GetPath(const std::string& path) const;
+	FileBuffer Load(const std::string& path, IoScheduler::Priority priority = IoScheduler::Priority::PLAYBACK) const;
 	bool HasPath(const std::string& path) const;
+
+	template<class F>
+	void ForEachFile(const F& processor) const {
+		for (auto& file : files_)
+			processor(file);
+	}
 };
 
 #endif // DATAMANAGER_HH
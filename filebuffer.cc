@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+#include "filebuffer.hh"
+
+FileBuffer::FileBuffer() : mapping_(nullptr), mapping_size_(0), data_(nullptr), size_(0) {
+}
+
+FileBuffer::FileBuffer(const std::string& path) : FileBuffer() {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		throw std::runtime_error("cannot open data file");
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("cannot stat data file");
+	}
+
+	if (st.st_size > 0) {
+		mapping_size_ = st.st_size;
+		mapping_ = mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd, 0);
+	}
+
+	close(fd);
+
+	if (mapping_ == MAP_FAILED) {
+		mapping_ = nullptr;
+		throw std::runtime_error("cannot map data file");
+	}
+
+	data_ = static_cast<const char*>(mapping_);
+	size_ = mapping_size_;
+}
+
+FileBuffer::FileBuffer(const std::string& path, off_t offset, size_t size) : FileBuffer() {
+	if (size == 0)
+		return;
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		throw std::runtime_error("cannot open data file");
+
+	// mapping offset must be page aligned
+	off_t page_offset = offset % sysconf(_SC_PAGESIZE);
+
+	mapping_size_ = size + page_offset;
+	mapping_ = mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd, offset - page_offset);
+
+	close(fd);
+
+	if (mapping_ == MAP_FAILED) {
+		mapping_ = nullptr;
+		throw std::runtime_error("cannot map data file");
+	}
+
+	data_ = static_cast<const char*>(mapping_) + page_offset;
+	size_ = size;
+}
+
+FileBuffer::FileBuffer(std::vector<char>&& storage) : FileBuffer() {
+	storage_.swap(storage);
+	data_ = storage_.data();
+	size_ = storage_.size();
+}
+
+FileBuffer::FileBuffer(FileBuffer&& other) : mapping_(other.mapping_), mapping_size_(other.mapping_size_), storage_(std::move(other.storage_)), data_(other.data_), size_(other.size_) {
+	other.mapping_ = nullptr;
+	other.mapping_size_ = 0;
+	other.data_ = nullptr;
+	other.size_ = 0;
+}
+
+FileBuffer::~FileBuffer() {
+	if (mapping_ != nullptr)
+		munmap(mapping_, mapping_size_);
+}
+
+FileBuffer& FileBuffer::operator=(FileBuffer&& other) {
+	if (&other == this)
+		return *this;
+
+	if (mapping_ != nullptr)
+		munmap(mapping_, mapping_size_);
+
+	mapping_ = other.mapping_;
+	mapping_size_ = other.mapping_size_;
+	storage_ = std::move(other.storage_);
+	data_ = other.data_;
+	size_ = other.size_;
+
+	other.mapping_ = nullptr;
+	other.mapping_size_ = 0;
+	other.data_ = nullptr;
+	other.size_ = 0;
+
+	return *this;
+}
+
+const char* FileBuffer::GetData() const {
+	return data_;
+}
+
+size_t FileBuffer::GetSize() const {
+	return size_;
+}
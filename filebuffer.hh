@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILEBUFFER_HH
+#define FILEBUFFER_HH
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+// Read-only byte range of a file, either memory mapped or read
+// into heap storage
+class FileBuffer {
+protected:
+	void* mapping_;
+	size_t mapping_size_;
+
+	std::vector<char> storage_;
+
+	const char* data_;
+	size_t size_;
+
+public:
+	FileBuffer();
+	FileBuffer(const std::string& path);
+	FileBuffer(const std::string& path, off_t offset, size_t size);
+	FileBuffer(std::vector<char>&& storage);
+	FileBuffer(FileBuffer&& other);
+	~FileBuffer();
+
+	FileBuffer& operator=(FileBuffer&& other);
+
+	FileBuffer(const FileBuffer&) = delete;
+	FileBuffer& operator=(const FileBuffer&) = delete;
+
+	const char* GetData() const;
+	size_t GetSize() const;
+};
+
+#endif // FILEBUFFER_HH
@@ -20,85 +20,161 @@
 #ifndef GAMEEVENTLISTENER_HH
 #define GAMEEVENTLISTENER_HH
 
-#include <list>
+#include <cstdint>
 #include <stdexcept>
 
+#include "inplacefunction.hh"
 #include "movplayer.hh"
 #include "gameinterface.hh"
 
+// Dispatcher of game events to handlers installed by script
+//
+// Handlers are stored in fixed capacity arrays of InplaceFunctions,
+// so installing and resetting them, which happens on each scene
+// transition, never allocates memory. Control event handlers are
+// kept separately for each event, so only relevant ones are called.
 class GameEventListener : public MovPlayer::EventListener, public GameInterface::EventListener {
 public:
-	typedef std::function<void(GameInterface::ControlEvent)> ControlEventHandler;
-	typedef std::function<void(const SDL2pp::Point&)> PointEventHandler;
-	typedef std::function<void()> EndOfClipEventHandler;
+	typedef InplaceFunction<void()> ControlEventHandler;
+	typedef InplaceFunction<void(const SDL2pp::Point&)> PointEventHandler;
+	typedef InplaceFunction<bool(const SDL2pp::Point&)> PointHoverEventHandler;
+	typedef InplaceFunction<void()> EndOfClipEventHandler;
+
+	enum {
+		NUM_CONTROL_EVENTS = (int)GameInterface::ControlEvent::ULTRAVIOLET + 1,
+
+		MAX_HANDLERS = 8,
+		MAX_STACK_DEPTH = 8,
+	};
 
 private:
-	std::list<ControlEventHandler> control_event_handlers_;
-	std::list<PointEventHandler> point_event_handlers_;
-	std::list<EndOfClipEventHandler> endofclip_event_handlers_;
+	template <typename Handler>
+	class HandlerList {
+	private:
+		Handler handlers_[MAX_HANDLERS];
+		size_t size_;
+
+	public:
+		HandlerList() : size_(0) {
+		}
+
+		template <typename F>
+		void Add(F&& handler) {
+			if (size_ == MAX_HANDLERS)
+				throw std::runtime_error("too many event handlers");
+			handlers_[size_++].Assign(std::forward<F>(handler));
+		}
+
+		void Resize(size_t size) {
+			while (size_ > size)
+				handlers_[--size_].Reset();
+		}
+
+		size_t Size() const {
+			return size_;
+		}
+
+		const Handler& operator[](size_t n) const {
+			return handlers_[n];
+		}
+	};
 
 	struct StackEntry {
-		size_t control_events;
-		size_t point_events;
-		size_t endofclip_events;
+		uint8_t control_events[NUM_CONTROL_EVENTS];
+		uint8_t point_events;
+		uint8_t point_hover_events;
+		uint8_t endofclip_events;
 	};
 
-	std::list<StackEntry> handler_state_stack_;
+private:
+	HandlerList<ControlEventHandler> control_event_handlers_[NUM_CONTROL_EVENTS];
+	HandlerList<PointEventHandler> point_event_handlers_;
+	HandlerList<PointHoverEventHandler> point_hover_event_handlers_;
+	HandlerList<EndOfClipEventHandler> endofclip_event_handlers_;
+
+	StackEntry handler_state_stack_[MAX_STACK_DEPTH];
+	size_t handler_state_stack_depth_;
 
 public:
+	GameEventListener() : handler_state_stack_depth_(0) {
+	}
+
 	virtual ~GameEventListener() {
 	}
 
-	void AddControlEventHandler(ControlEventHandler&& handler) {
-		control_event_handlers_.emplace_back(std::move(handler));
+	template <typename F>
+	void AddControlEventHandler(GameInterface::ControlEvent event, F&& handler) {
+		control_event_handlers_[(int)event].Add(std::forward<F>(handler));
+	}
+
+	template <typename F>
+	void AddPointEventHandler(F&& handler) {
+		point_event_handlers_.Add(std::forward<F>(handler));
 	}
 
-	void AddPointEventHandler(PointEventHandler&& handler) {
-		point_event_handlers_.emplace_back(std::move(handler));
+	template <typename F>
+	void AddPointHoverEventHandler(F&& handler) {
+		point_hover_event_handlers_.Add(std::forward<F>(handler));
 	}
 
-	void AddEndOfClipEventHandler(EndOfClipEventHandler&& handler) {
-		endofclip_event_handlers_.emplace_back(std::move(handler));
+	template <typename F>
+	void AddEndOfClipEventHandler(F&& handler) {
+		endofclip_event_handlers_.Add(std::forward<F>(handler));
 	}
 
 	virtual void ProcessControlEvent(GameInterface::ControlEvent event) override {
-		for (auto i = control_event_handlers_.begin(); i != control_event_handlers_.end(); i++)
-			(*i)(event);
+		const HandlerList<ControlEventHandler>& handlers = control_event_handlers_[(int)event];
+		for (size_t i = 0; i < handlers.Size(); i++)
+			handlers[i]();
 	}
 
 	virtual void ProcessPointEvent(const SDL2pp::Point& point) override {
-		for (auto i = point_event_handlers_.rbegin(); i != point_event_handlers_.rend(); i++)
-			(*i)(point);
+		for (size_t i = point_event_handlers_.Size(); i > 0; i--)
+			point_event_handlers_[i - 1](point);
+	}
+
+	virtual bool ProcessPointHoverEvent(const SDL2pp::Point& point) override {
+		for (size_t i = point_hover_event_handlers_.Size(); i > 0; i--)
+			if (point_hover_event_handlers_[i - 1](point))
+				return true;
+		return false;
 	}
 
 	virtual void ProcessEndOfClipEvent() override {
-		for (auto i = endofclip_event_handlers_.rbegin(); i != endofclip_event_handlers_.rend(); i++)
-			(*i)();
+		for (size_t i = endofclip_event_handlers_.Size(); i > 0; i--)
+			endofclip_event_handlers_[i - 1]();
 	}
 
 	void PushHandlerState() {
-		handler_state_stack_.push_back({
-				control_event_handlers_.size(),
-				point_event_handlers_.size(),
-				endofclip_event_handlers_.size()
-			});
+		if (handler_state_stack_depth_ == MAX_STACK_DEPTH)
+			throw std::runtime_error("event handler stack overflow");
+
+		StackEntry& entry = handler_state_stack_[handler_state_stack_depth_++];
+		for (int i = 0; i < NUM_CONTROL_EVENTS; i++)
+			entry.control_events[i] = control_event_handlers_[i].Size();
+		entry.point_events = point_event_handlers_.Size();
+		entry.point_hover_events = point_hover_event_handlers_.Size();
+		entry.endofclip_events = endofclip_event_handlers_.Size();
 	}
 
 	void PopHandlerState() {
-		if (handler_state_stack_.empty())
+		if (handler_state_stack_depth_ == 0)
 			throw std::runtime_error("event handler stack underflow");
 
-		control_event_handlers_.resize(handler_state_stack_.back().control_events);
-		point_event_handlers_.resize(handler_state_stack_.back().point_events);
-		endofclip_event_handlers_.resize(handler_state_stack_.back().endofclip_events);
-
-		handler_state_stack_.pop_back();
+		const StackEntry& entry = handler_state_stack_[--handler_state_stack_depth_];
+		for (int i = 0; i < NUM_CONTROL_EVENTS; i++)
+			control_event_handlers_[i].Resize(entry.control_events[i]);
+		point_event_handlers_.Resize(entry.point_events);
+		point_hover_event_handlers_.Resize(entry.point_hover_events);
+		endofclip_event_handlers_.Resize(entry.endofclip_events);
 	}
 
 	void ResetHandlers() {
-		control_event_handlers_.clear();
-		point_event_handlers_.clear();
-		endofclip_event_handlers_.clear();
+		for (int i = 0; i < NUM_CONTROL_EVENTS; i++)
+			control_event_handlers_[i].Resize(0);
+		point_event_handlers_.Resize(0);
+		point_hover_event_handlers_.Resize(0);
+		endofclip_event_handlers_.Resize(0);
 	}
 };
 
@@ -17,9 +17,11 @@
  * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <SDL2/SDL_timer.h>
 #include <SDL2/SDL_events.h>
 
+#include "clock.hh"
+#include "tracer.hh"
+
 #include "gameinterface.hh"
 
 constexpr unsigned int GameInterface::Constants::ControlDelayMs;
@@ -54,12 +56,10 @@ const GameInterface::ControlMap GameInterface::controls_ = {
 	{ GameInterface::Control::COLORS_6, { GameInterface::Texture::MLHILITE, { 553, 307, 23, 25 }, { 122, 21, 23, 25 } } },
 };
 
-GameInterface::GameInterface(SDL2pp::Renderer& renderer, const DataManager& datamanager)
+GameInterface::GameInterface(SDL2pp::Renderer& renderer, TextureCache& textures, const Clock& clock)
 	: renderer_(renderer),
-	  background_(renderer, datamanager.GetPath("images/intrface.bmp")),
-	  fnhighlights_(renderer, datamanager.GetPath("images/fnhilite.rle")),
-	  mlhighlights_(renderer, datamanager.GetPath("images/mlhilite.bmp")),
-	  patterns_(renderer, datamanager.GetPath("images/patterns.bmp")),
+	  textures_(textures),
+	  clock_(clock),
 	  currently_activated_control_(GameInterface::Control::NONE),
 	  ui_enabled_(true),
 	  fullscreen_video_(false),
@@ -67,13 +67,40 @@ GameInterface::GameInterface(SDL2pp::Renderer& renderer, const DataManager& data
 	  selected_pattern_(-1),
 	  laser_enabled_(false),
 	  navigation_mask_(0),
-	  listener_(nullptr) {
+	  listener_(nullptr),
+	  hand_cursor_(SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_HAND)),
+	  hovering_(false),
+	  pointer_known_(false) {
+	AcquireTextures();
 }
 
 GameInterface::~GameInterface() {
+	if (hand_cursor_ != nullptr) {
+		SetHovering(false);
+		SDL_FreeCursor(hand_cursor_);
+	}
+}
+
+void GameInterface::AcquireTextures() {
+	background_ = textures_.Get("images/intrface.bmp");
+	fnhighlights_ = textures_.Get("images/fnhilite.rle");
+	mlhighlights_ = textures_.Get("images/mlhilite.bmp");
+	patterns_ = textures_.Get("images/patterns.bmp");
+}
+
+void GameInterface::ReleaseTextures() {
+	// let texture cache evict interface textures while interface
+	// is not visible (e.g. a puzzle screen is active); these are
+	// reacquired on next Render()
+	background_.reset();
+	fnhighlights_.reset();
+	mlhighlights_.reset();
+	patterns_.reset();
 }
 
 void GameInterface::Render(SDL2pp::Texture* video) {
+	TraceSpan span("ui", "render");
+
 	if (fullscreen_video_) {
 		// fullscreen video is enabled, we only need to render it
 		if (video)
@@ -87,13 +114,16 @@ void GameInterface::Render(SDL2pp::Texture* video) {
 		return;
 	}
 
-	renderer_.Copy(background_, SDL2pp::NullOpt, SDL2pp::Rect(0, 0, 640, 480));
+	if (!background_)
+		AcquireTextures();
+
+	renderer_.Copy(*background_, SDL2pp::NullOpt, SDL2pp::Rect(0, 0, 640, 480));
 
 	// render currently active control
 	ControlMap::const_iterator active_control_info = controls_.find(currently_activated_control_);
 	if (active_control_info != controls_.end())
 		renderer_.Copy(
-				(active_control_info->second.texture == Texture::MLHILITE) ? mlhighlights_ : fnhighlights_,
+				(active_control_info->second.texture == Texture::MLHILITE) ? *mlhighlights_ : *fnhighlights_,
 				active_control_info->second.source_rect,
 				active_control_info->second.rect
 			);
@@ -101,10 +131,10 @@ void GameInterface::Render(SDL2pp::Texture* video) {
 	// render ir/vis/vis color bar
 	switch (colors_mode_) {
 	case ColorsMode::IR:
-		renderer_.Copy(mlhighlights_, SDL2pp::Rect(1, 48, 176, 19), SDL2pp::Rect(404, 335, 176, 19));
+		renderer_.Copy(*mlhighlights_, SDL2pp::Rect(1, 48, 176, 19), SDL2pp::Rect(404, 335, 176, 19));
 		break;
 	case ColorsMode::UV:
-		renderer_.Copy(mlhighlights_, SDL2pp::Rect(1, 69, 176, 19), SDL2pp::Rect(404, 335, 176, 19));
+		renderer_.Copy(*mlhighlights_, SDL2pp::Rect(1, 69, 176, 19), SDL2pp::Rect(404, 335, 176, 19));
 		break;
 	default:
 		break;
@@ -112,11 +142,11 @@ void GameInterface::Render(SDL2pp::Texture* video) {
 
 	// laser indicator
 	if (laser_enabled_)
-		renderer_.Copy(fnhighlights_, SDL2pp::Rect(0, 173, 55, 43), SDL2pp::Rect(28, 18, 55, 43));
+		renderer_.Copy(*fnhighlights_, SDL2pp::Rect(0, 173, 55, 43), SDL2pp::Rect(28, 18, 55, 43));
 
 	// pattern
 	if (selected_pattern_ >= 0)
-		renderer_.Copy(patterns_, SDL2pp::Rect(0, selected_pattern_ * 36, 105, 36), SDL2pp::Rect(162, 412, 105, 36));
+		renderer_.Copy(*patterns_, SDL2pp::Rect(0, selected_pattern_ * 36, 105, 36), SDL2pp::Rect(162, 412, 105, 36));
 
 	// video
 	if (video)
@@ -141,7 +171,7 @@ void GameInterface::TryActivateControl(Control control) {
 		return;
 
 	currently_activated_control_ = control;
-	control_activation_time_ = SDL_GetTicks();
+	control_activation_time_ = clock_.GetTicks();
 }
 
 void GameInterface::ProcessControlAction(Control control) {
@@ -200,16 +230,28 @@ void GameInterface::EmitPointEvent(const SDL2pp::Point& point) {
 		listener_->ProcessPointEvent(point);
 }
 
+bool GameInterface::EmitPointHoverEvent(const SDL2pp::Point& point) {
+	if (listener_)
+		return listener_->ProcessPointHoverEvent(point);
+	return false;
+}
+
 void GameInterface::Update(unsigned int ticks) {
 	if (ticks > control_activation_time_ + GameInterface::Constants::ControlDelayMs) {
 		ProcessControlAction(currently_activated_control_);
 		currently_activated_control_ = Control::NONE;
 	}
+
+	UpdateHovering();
 }
 
 void GameInterface::ProcessEvent(const SDL_Event& event) {
+	TraceSpan span("ui", "process event");
+
 	if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT)
 		ProcessMouseDown(event.button);
+	else if (event.type == SDL_MOUSEMOTION)
+		ProcessMouseMotion(event.motion);
 	else if (event.type == SDL_KEYUP)
 		ProcessKeyUp(event.key);
 }
@@ -256,17 +298,44 @@ void GameInterface::ProcessMouseDown(const SDL_MouseButtonEvent& button) {
 			if (control.second.rect.Contains(SDL2pp::Point(button.x, button.y)))
 				TryActivateControl(control.first);
 
-	SDL2pp::Point target(0, 0);
+	SDL2pp::Point target;
+	if (ScreenToVideo(button.x, button.y, target))
+		EmitPointEvent(target);
+}
+
+void GameInterface::ProcessMouseMotion(const SDL_MouseMotionEvent& motion) {
+	pointer_known_ = true;
+	pointer_ = SDL2pp::Point(motion.x, motion.y);
+
+	UpdateHovering();
+}
+
+bool GameInterface::ScreenToVideo(int x, int y, SDL2pp::Point& target) const {
 	if (fullscreen_video_) {
-		target.SetX(button.x / 2);
-		target.SetY(button.y / 2);
+		target.SetX(x / 2);
+		target.SetY(y / 2);
 	} else {
-		target.SetX(button.x - 295);
-		target.SetY(button.y - 16);
+		target.SetX(x - 295);
+		target.SetY(y - 16);
 	}
 
-	if (target.GetX() >= 0 && target.GetY() >= 0 && target.GetX() < 320 && target.GetY() < 240)
-		EmitPointEvent(target);
+	return target.GetX() >= 0 && target.GetY() >= 0 && target.GetX() < 320 && target.GetY() < 240;
+}
+
+void GameInterface::SetHovering(bool hovering) {
+	if (hovering == hovering_ || hand_cursor_ == nullptr)
+		return;
+
+	SDL_SetCursor(hovering ? hand_cursor_ : SDL_GetDefaultCursor());
+	hovering_ = hovering;
+}
+
+void GameInterface::UpdateHovering() {
+	if (!pointer_known_)
+		return;
+
+	SDL2pp::Point target;
+	SetHovering(ui_enabled_ && ScreenToVideo(pointer_.GetX(), pointer_.GetY(), target) && EmitPointHoverEvent(target));
 }
 
 void GameInterface::SetListener(GameInterface::EventListener* listener) {
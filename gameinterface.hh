@@ -21,13 +21,16 @@
 #define GAMEINTERFACE_HH
 
 #include <map>
+#include <functional>
 
 #include <SDL2/SDL_events.h>
+#include <SDL2/SDL_mouse.h>
 
-#include <SDL2pp/Texture.hh>
 #include <SDL2pp/Renderer.hh>
 
-#include "datamanager.hh"
+#include "texturecache.hh"
+
+class Clock;
 
 class GameInterface {
 public:
@@ -65,6 +68,11 @@ public:
 
 		virtual void ProcessPointEvent(const SDL2pp::Point&) {
 		}
+
+		// return whether there's something clickable under the point
+		virtual bool ProcessPointHoverEvent(const SDL2pp::Point&) {
+			return false;
+		}
 	};
 
 protected:
@@ -138,12 +146,14 @@ protected:
 
 protected:
 	SDL2pp::Renderer& renderer_;
+	TextureCache& textures_;
+	const Clock& clock_;
 
 	// Textures
-	SDL2pp::Texture background_;
-	SDL2pp::Texture fnhighlights_;
-	SDL2pp::Texture mlhighlights_;
-	SDL2pp::Texture patterns_;
+	TextureCache::TexturePtr background_;
+	TextureCache::TexturePtr fnhighlights_;
+	TextureCache::TexturePtr mlhighlights_;
+	TextureCache::TexturePtr patterns_;
 
 	// Click processing
 	Control currently_activated_control_;
@@ -158,23 +168,41 @@ protected:
 
 	EventListener* listener_;
 
+	// Hover feedback; hot zones change with the scene while the
+	// mouse stays still, so the last pointer position is tested
+	// again on every update
+	SDL_Cursor* hand_cursor_;
+	bool hovering_;
+	bool pointer_known_;
+	SDL2pp::Point pointer_;
+
 protected:
+	void AcquireTextures();
+
+	bool ScreenToVideo(int x, int y, SDL2pp::Point& target) const;
+	void SetHovering(bool hovering);
+	void UpdateHovering();
+
 	void TryActivateControl(Control control);
 	void ProcessControlAction(Control control);
 
 	void EmitControlEvent(ControlEvent event);
 	void EmitPointEvent(const SDL2pp::Point& point);
+	bool EmitPointHoverEvent(const SDL2pp::Point& point);
 
 public:
-	GameInterface(SDL2pp::Renderer& renderer, const DataManager& datamanager);
+	GameInterface(SDL2pp::Renderer& renderer, TextureCache& textures, const Clock& clock);
 	~GameInterface();
 
 	void ProcessEvent(const SDL_Event& event);
 	void ProcessMouseDown(const SDL_MouseButtonEvent& button);
+	void ProcessMouseMotion(const SDL_MouseMotionEvent& motion);
 	void ProcessKeyUp(const SDL_KeyboardEvent& key);
 	void Update(unsigned int ticks);
 	void Render(SDL2pp::Texture* video);
 
+	void ReleaseTextures();
+
 	void SetListener(EventListener* listener);
 
 	void EnableLaserMode();
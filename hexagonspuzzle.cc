@@ -23,8 +23,8 @@
 
 #include "hexagonspuzzle.hh"
 
-#include "datamanager.hh"
 #include "logger.hh"
+#include "tracer.hh"
 
 // TODO: spinner lights around level indicators are missing
 // TODO: solve animation
@@ -154,14 +154,14 @@ void HexagonsPuzzle::RecalculateSummary() {
 	}
 }
 
-HexagonsPuzzle::HexagonsPuzzle(SDL2pp::Renderer& renderer, const DataManager& datamanager)
+HexagonsPuzzle::HexagonsPuzzle(SDL2pp::Renderer& renderer, TextureCache& textures)
 	: renderer_(renderer),
-	  background_(renderer, datamanager.GetPath("images/plaphex/puzz2bg.bmp")),
-	  levels_(renderer, datamanager.GetPath("images/plaphex/puz2goal.bmp")),
-	  levels_hl_(renderer, datamanager.GetPath("images/plaphex/puz2glhl.bmp")),
-	  pieces_(renderer, datamanager.GetPath("images/plaphex/puz2peic.bmp")),
-	  chaser_(renderer, datamanager.GetPath("images/plaphex/chaser.rle")) {
-	Log("puzzle") << "starting hexagons puzzle";
+	  background_(textures.Get("images/plaphex/puzz2bg.bmp")),
+	  levels_(textures.Get("images/plaphex/puz2goal.bmp")),
+	  levels_hl_(textures.Get("images/plaphex/puz2glhl.bmp")),
+	  pieces_(textures.Get("images/plaphex/puz2peic.bmp")),
+	  chaser_(textures.Get("images/plaphex/chaser.rle")) {
+	Log(LogCategory::PUZZLE) << "starting hexagons puzzle";
 
 	SetupLevel(0);
 }
@@ -170,6 +170,8 @@ HexagonsPuzzle::~HexagonsPuzzle() {
 }
 
 bool HexagonsPuzzle::ProcessEvent(const SDL_Event& event) {
+	TraceSpan span("puzzle", "hexagons process event");
+
 	if (event.type == SDL_MOUSEBUTTONDOWN) {
 		int npiece = -1;
 		for (auto pieceloc = piece_locations_.begin(); pieceloc != piece_locations_.end(); pieceloc++) {
@@ -195,10 +197,10 @@ bool HexagonsPuzzle::ProcessEvent(const SDL_Event& event) {
 		if (all_lines_.size() == 15) { // all lines filled in central hexagon
 			// XXX: support difficulty levels here
 			if (level_ == 5) {
-				Log("puzzle") << "  congrats, puzzle is solved";
+				Log(LogCategory::PUZZLE) << "  congrats, puzzle is solved";
 				return false;
 			} else {
-				Log("puzzle") << "  congrats, level solved";
+				Log(LogCategory::PUZZLE) << "  congrats, level solved";
 				SetupLevel(level_ + 1);
 			}
 		}
@@ -212,13 +214,15 @@ bool HexagonsPuzzle::Update() {
 }
 
 void HexagonsPuzzle::Render() {
+	TraceSpan span("puzzle", "hexagons render");
+
 	// background
-	renderer_.Copy(background_, SDL2pp::NullOpt, SDL2pp::Rect(0, 0, 640, 480));
+	renderer_.Copy(*background_, SDL2pp::NullOpt, SDL2pp::Rect(0, 0, 640, 480));
 
 	// level indicator
 	for (int i = 0; i < level_; i++) {
 		renderer_.Copy(
-				levels_,
+				*levels_,
 				SDL2pp::Rect(52 * i, 0, 52, 52),
 				SDL2pp::Rect(level_locations_[i].x, level_locations_[i].y, 52, 52)
 			);
@@ -24,12 +24,10 @@
 #include <vector>
 #include <set>
 
-#include <SDL2pp/Texture.hh>
 #include <SDL2pp/Renderer.hh>
 
 #include "screen.hh"
-
-class DataManager;
+#include "texturecache.hh"
 
 class HexagonsPuzzle : public Screen {
 private:
@@ -47,11 +45,11 @@ private:
 	SDL2pp::Renderer& renderer_;
 
 	// Textures
-	SDL2pp::Texture background_;
-	SDL2pp::Texture levels_;
-	SDL2pp::Texture levels_hl_;
-	SDL2pp::Texture pieces_;
-	SDL2pp::Texture chaser_;
+	TextureCache::TexturePtr background_;
+	TextureCache::TexturePtr levels_;
+	TextureCache::TexturePtr levels_hl_;
+	TextureCache::TexturePtr pieces_;
+	TextureCache::TexturePtr chaser_;
 
 private:
 	int level_;
@@ -68,7 +66,7 @@ private:
 	void RecalculateSummary();
 
 public:
-	HexagonsPuzzle(SDL2pp::Renderer& renderer, const DataManager& datamanager);
+	HexagonsPuzzle(SDL2pp::Renderer& renderer, TextureCache& textures);
 	virtual ~HexagonsPuzzle();
 
 	bool ProcessEvent(const SDL_Event& event) override;
@@ -17,45 +17,252 @@
  * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+#include "textscanner.hh"
 
 #include "hotfile.hh"
 
-HotFile::HotFile(const std::string& path) {
-	std::ifstream stream(path, std::ios_base::in);
-	stream.exceptions(std::ifstream::badbit);
+namespace {
 
-	while (!stream.eof()) {
-		int frameno;
-		stream >> frameno;
+const char Signature[8] = { 'O', 'D', 'H', 'O', 'T', 'V', '0', '2' };
+const size_t SignatureVersionOffset = 6;
+const uint32_t ByteOrderMark = 0x01020304;
 
-		if (stream.fail())
-			break;
+struct Header {
+	char signature[8];
+	uint32_t byte_order;
+	uint32_t num_frames;
+	uint32_t num_rects;
+};
 
-		RectVector rects;
-		for (int i = 0; i < 8; i++) {
-			int x1, y1, x2, y2;
+}
+
+HotFile::HotFile(const std::string& path) : HotFile(FileBuffer(path)) {
+}
+
+HotFile::HotFile(const FileBuffer& data) : dense_(false) {
+	if (data.GetSize() >= sizeof(Signature) && memcmp(data.GetData(), Signature, SignatureVersionOffset) == 0)
+		ParseBinary(data.GetData(), data.GetSize());
+	else
+		Parse(data.GetData(), data.GetSize());
+}
+
+void HotFile::Parse(const char* data, size_t size) {
+	TextScanner scanner(data, size);
 
-			stream >> x1 >> y1 >> x2 >> y2;
+	offsets_.push_back(0);
 
-			if (stream.fail())
+	int frameno;
+	while (scanner.ReadInt(frameno)) {
+		bool complete = true;
+		for (int i = 0; i < RECTS_PER_FRAME; i++) {
+			int x1, y1, x2, y2;
+
+			if (!scanner.ReadInt(x1) || !scanner.ReadInt(y1) || !scanner.ReadInt(x2) || !scanner.ReadInt(y2)) {
+				complete = false;
 				break;
+			}
 
 			if (x1 != 0 || y1 != 0 || x2 != 0 || y2 != 0)
-				rects.emplace_back(x1, y1, x2 - x1, y2 - y1);
+				rects_.emplace_back(x1, y1, x2 - x1, y2 - y1);
 		}
 
-		entries_.emplace(std::make_pair(frameno, std::move(rects)));
+		// truncated frame is still used, but nothing after it
+		frames_.push_back(frameno);
+		offsets_.push_back(rects_.size());
+
+		if (!complete)
+			break;
+	}
+
+	Finalize();
+}
+
+void HotFile::ParseBinary(const char* data, size_t size) {
+	Header header;
+	if (size < sizeof(header))
+		throw std::runtime_error("binary hot file is truncated");
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.signature, Signature, sizeof(Signature)) != 0)
+		throw std::runtime_error("binary hot file was compiled by incompatible version, please recompile it");
+	if (header.byte_order != ByteOrderMark)
+		throw std::runtime_error("binary hot file was compiled for different byte order");
+
+	size_t frames_size = (size_t)header.num_frames * sizeof(int32_t);
+	size_t offsets_size = ((size_t)header.num_frames + 1) * sizeof(uint32_t);
+	size_t rects_size = (size_t)header.num_rects * 4 * sizeof(int32_t);
+	size_t grids_size = (size_t)header.num_frames * GRID_CELLS;
+
+	if (size < sizeof(header) + frames_size + offsets_size + rects_size + grids_size)
+		throw std::runtime_error("binary hot file is truncated");
+
+	data += sizeof(header);
+
+	frames_.resize(header.num_frames);
+	memcpy(frames_.data(), data, frames_size);
+	data += frames_size;
+
+	offsets_.resize(header.num_frames + 1);
+	memcpy(offsets_.data(), data, offsets_size);
+	data += offsets_size;
+
+	rects_.reserve(header.num_rects);
+	for (uint32_t i = 0; i < header.num_rects; i++, data += 4 * sizeof(int32_t)) {
+		int32_t coords[4];
+		memcpy(coords, data, sizeof(coords));
+		rects_.emplace_back(coords[0], coords[1], coords[2], coords[3]);
+	}
+
+	grids_.resize(grids_size);
+	memcpy(grids_.data(), data, grids_size);
+
+	// validate, so lookups may go unchecked
+	if (offsets_.front() != 0 || offsets_.back() != header.num_rects)
+		throw std::runtime_error("binary hot file is corrupt");
+
+	for (size_t nframe = 0; nframe < frames_.size(); nframe++) {
+		if (nframe > 0 && frames_[nframe] <= frames_[nframe - 1])
+			throw std::runtime_error("binary hot file is corrupt");
+		if (offsets_[nframe + 1] < offsets_[nframe] || offsets_[nframe + 1] - offsets_[nframe] > RECTS_PER_FRAME)
+			throw std::runtime_error("binary hot file is corrupt");
+
+		unsigned int valid_mask = (1 << (offsets_[nframe + 1] - offsets_[nframe])) - 1;
+		for (size_t ncell = 0; ncell < GRID_CELLS; ncell++)
+			if ((grids_[nframe * GRID_CELLS + ncell] & ~valid_mask) != 0)
+				throw std::runtime_error("binary hot file is corrupt");
+	}
+
+	dense_ = frames_.empty() || (int64_t)frames_.back() - frames_.front() + 1 == (int64_t)frames_.size();
+}
+
+void HotFile::Finalize() {
+	// text files are normally in frame order, but if not, sort
+	// frames keeping the first one of duplicates
+	bool ordered = true;
+	for (size_t nframe = 1; nframe < frames_.size() && ordered; nframe++)
+		ordered = frames_[nframe] > frames_[nframe - 1];
+
+	if (!ordered) {
+		std::vector<size_t> order(frames_.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+				return frames_[a] < frames_[b];
+			});
+
+		std::vector<int32_t> frames;
+		std::vector<uint32_t> offsets(1, 0);
+		std::vector<SDL2pp::Rect> rects;
+
+		for (size_t nframe : order) {
+			if (!frames.empty() && frames.back() == frames_[nframe])
+				continue;
+
+			frames.push_back(frames_[nframe]);
+			rects.insert(rects.end(), rects_.begin() + offsets_[nframe], rects_.begin() + offsets_[nframe + 1]);
+			offsets.push_back(rects.size());
+		}
+
+		frames_.swap(frames);
+		offsets_.swap(offsets);
+		rects_.swap(rects);
+	}
+
+	frames_.shrink_to_fit();
+	offsets_.shrink_to_fit();
+	rects_.shrink_to_fit();
+
+	grids_.assign(frames_.size() * GRID_CELLS, 0);
+	for (size_t nframe = 0; nframe < frames_.size(); nframe++)
+		BuildGrid(nframe);
+
+	dense_ = frames_.empty() || (int64_t)frames_.back() - frames_.front() + 1 == (int64_t)frames_.size();
+}
+
+void HotFile::BuildGrid(size_t nframe) {
+	uint8_t* grid = grids_.data() + nframe * GRID_CELLS;
+
+	for (uint32_t nrect = 0; nrect < offsets_[nframe + 1] - offsets_[nframe]; nrect++) {
+		const SDL2pp::Rect& rect = rects_[offsets_[nframe] + nrect];
+		if (rect.GetW() <= 0 || rect.GetH() <= 0)
+			continue;
+
+		int firstcol = std::max(rect.GetX(), 0) / CELL_WIDTH;
+		int firstrow = std::max(rect.GetY(), 0) / CELL_HEIGHT;
+		int lastcol = std::min(rect.GetX() + rect.GetW() - 1, AREA_WIDTH - 1) / CELL_WIDTH;
+		int lastrow = std::min(rect.GetY() + rect.GetH() - 1, AREA_HEIGHT - 1) / CELL_HEIGHT;
+
+		for (int row = firstrow; row <= lastrow; row++)
+			for (int col = firstcol; col <= lastcol; col++)
+				grid[row * GRID_COLS + col] |= 1 << nrect;
 	}
 }
 
 HotFile::~HotFile() {
 }
 
-const HotFile::RectVector& HotFile::GetRectsForFrame(int frame) const {
-	EntryMap::const_iterator entry = entries_.find(frame);
-	if (entry == entries_.end())
+int HotFile::FindFrame(int frame) const {
+	if (frames_.empty() || frame < frames_.front() || frame > frames_.back())
+		return -1;
+
+	if (dense_)
+		return frame - frames_.front();
+
+	std::vector<int32_t>::const_iterator found = std::lower_bound(frames_.begin(), frames_.end(), frame);
+	if (*found != frame)
+		return -1;
+
+	return found - frames_.begin();
+}
+
+HotFile::RectRange HotFile::GetRectsForFrame(int frame) const {
+	int nframe = FindFrame(frame);
+	if (nframe == -1)
 		throw std::runtime_error("no hotspots for requested frame");
-	return entry->second;
+	return RectRange(rects_.data() + offsets_[nframe], rects_.data() + offsets_[nframe + 1]);
+}
+
+int HotFile::HitTest(int frame, const SDL2pp::Point& point) const {
+	if (point.GetX() < 0 || point.GetY() < 0 || point.GetX() >= AREA_WIDTH || point.GetY() >= AREA_HEIGHT)
+		return -1;
+
+	int nframe = FindFrame(frame);
+	if (nframe == -1)
+		return -1;
+
+	const SDL2pp::Rect* rects = rects_.data() + offsets_[nframe];
+	unsigned int mask = grids_[nframe * GRID_CELLS + point.GetY() / CELL_HEIGHT * GRID_COLS + point.GetX() / CELL_WIDTH];
+	for (int nrect = 0; mask != 0; nrect++, mask >>= 1)
+		if ((mask & 1) && rects[nrect].Contains(point))
+			return nrect;
+
+	return -1;
+}
+
+void HotFile::Save(const std::string& path) const {
+	std::ofstream stream(path, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+	stream.exceptions(std::ofstream::badbit | std::ofstream::failbit);
+
+	Header header;
+	memcpy(header.signature, Signature, sizeof(Signature));
+	header.byte_order = ByteOrderMark;
+	header.num_frames = frames_.size();
+	header.num_rects = rects_.size();
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	stream.write(reinterpret_cast<const char*>(frames_.data()), frames_.size() * sizeof(int32_t));
+	stream.write(reinterpret_cast<const char*>(offsets_.data()), offsets_.size() * sizeof(uint32_t));
+
+	for (auto& rect : rects_) {
+		int32_t coords[4] = { rect.GetX(), rect.GetY(), rect.GetW(), rect.GetH() };
+		stream.write(reinterpret_cast<const char*>(coords), sizeof(coords));
+	}
+
+	stream.write(reinterpret_cast<const char*>(grids_.data()), grids_.size());
 }
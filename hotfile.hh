@@ -20,27 +20,110 @@
 #ifndef HOTFILE_HH
 #define HOTFILE_HH
 
+#include <cstdint>
 #include <string>
 #include <vector>
-#include <map>
 
 #include <SDL2pp/Rect.hh>
 
+#include "filebuffer.hh"
+
+// Hot zones of a movie: up to 8 clickable rectangles per frame
+//
+// Data is kept in flat arrays: sorted frame numbers, offsets of
+// each frame's rectangles in a single rectangle pool, and a hit
+// testing grid per frame. Frame lookup is direct indexing when
+// frame numbers form a contiguous range, binary search otherwise.
+//
+// For hit testing, the 320x240 movie area of each frame is split
+// into a coarse grid, each cell of which holds a bitmask of the
+// rectangles overlapping it, so a point only needs to be checked
+// against the few rectangles of its cell.
+//
+// Either original text file or a binary one produced from it by
+// opendaed-compile is accepted. Binary file is a dump of the
+// arrays (all integers are in host byte order):
+//
+//   header:
+//     char[8]  signature "ODHOTV02"
+//     uint32   byte order mark 0x01020304
+//     uint32   number of frames
+//     uint32   number of rectangles
+//   int32[frames]       frame numbers, ascending
+//   uint32[frames + 1]  offsets of frame rectangles in the pool
+//   int32[rects][4]     rectangles as x, y, w, h
+//   uint8[frames][8][8] hit testing grids
 class HotFile {
 public:
-	typedef std::vector<SDL2pp::Rect> RectVector;
+	enum {
+		RECTS_PER_FRAME = 8,
+
+		AREA_WIDTH = 320,
+		AREA_HEIGHT = 240,
+		GRID_COLS = 8,
+		GRID_ROWS = 8,
+		GRID_CELLS = GRID_COLS * GRID_ROWS,
+		CELL_WIDTH = AREA_WIDTH / GRID_COLS,
+		CELL_HEIGHT = AREA_HEIGHT / GRID_ROWS,
+	};
+
+	class RectRange {
+	private:
+		const SDL2pp::Rect* begin_;
+		const SDL2pp::Rect* end_;
+
+	public:
+		RectRange(const SDL2pp::Rect* begin, const SDL2pp::Rect* end) : begin_(begin), end_(end) {
+		}
+
+		const SDL2pp::Rect* begin() const {
+			return begin_;
+		}
+
+		const SDL2pp::Rect* end() const {
+			return end_;
+		}
+
+		size_t size() const {
+			return end_ - begin_;
+		}
+
+		const SDL2pp::Rect& operator[](size_t n) const {
+			return begin_[n];
+		}
+	};
 
 protected:
-	typedef std::map<int, RectVector> EntryMap;
+	std::vector<int32_t> frames_;
+	std::vector<uint32_t> offsets_;
+	std::vector<SDL2pp::Rect> rects_;
+	std::vector<uint8_t> grids_;
+
+	// frames_ is contiguous range of frame numbers
+	bool dense_;
 
 protected:
-	EntryMap entries_;
+	void Parse(const char* data, size_t size);
+	void ParseBinary(const char* data, size_t size);
+
+	void Finalize();
+	void BuildGrid(size_t nframe);
+
+	int FindFrame(int frame) const;
 
 public:
 	HotFile(const std::string& path);
+	HotFile(const FileBuffer& data);
 	~HotFile();
 
-	const RectVector& GetRectsForFrame(int frame) const;
+	RectRange GetRectsForFrame(int frame) const;
+
+	// index of the first rectangle of given frame which contains
+	// the point, or -1 if there's none (or no hot zones for the frame)
+	int HitTest(int frame, const SDL2pp::Point& point) const;
+
+	// write binary file
+	void Save(const std::string& path) const;
 };
 
 #endif // HOTFILE_HH
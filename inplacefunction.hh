@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPLACEFUNCTION_HH
+#define INPLACEFUNCTION_HH
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Callable wrapper similar to std::function, but which keeps the
+// callable in fixed size storage inside the object itself and thus
+// never allocates memory. Callables which don't fit are rejected
+// at compile time
+template <typename Signature, size_t StorageSize = 48>
+class InplaceFunction;
+
+template <typename R, typename... Args, size_t StorageSize>
+class InplaceFunction<R(Args...), StorageSize> {
+protected:
+	typedef R (*Invoker)(void*, Args...);
+	typedef void (*Destroyer)(void*);
+
+	typedef typename std::aligned_storage<StorageSize>::type Storage;
+
+protected:
+	Storage storage_;
+	Invoker invoke_;
+	Destroyer destroy_;
+
+protected:
+	template <typename F>
+	static R Invoke(void* storage, Args... args) {
+		return (*static_cast<F*>(storage))(std::forward<Args>(args)...);
+	}
+
+	template <typename F>
+	static void Destroy(void* storage) {
+		static_cast<F*>(storage)->~F();
+	}
+
+public:
+	InplaceFunction() : invoke_(nullptr), destroy_(nullptr) {
+	}
+
+	~InplaceFunction() {
+		Reset();
+	}
+
+	InplaceFunction(const InplaceFunction&) = delete;
+	InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+	template <typename F>
+	void Assign(F&& function) {
+		typedef typename std::decay<F>::type Functor;
+		static_assert(sizeof(Functor) <= sizeof(Storage), "callable does not fit into InplaceFunction storage");
+		static_assert(alignof(Functor) <= alignof(Storage), "callable is overaligned for InplaceFunction storage");
+
+		Reset();
+		new (&storage_) Functor(std::forward<F>(function));
+		invoke_ = &Invoke<Functor>;
+		destroy_ = &Destroy<Functor>;
+	}
+
+	void Reset() {
+		if (destroy_ != nullptr) {
+			destroy_(&storage_);
+			invoke_ = nullptr;
+			destroy_ = nullptr;
+		}
+	}
+
+	explicit operator bool() const {
+		return invoke_ != nullptr;
+	}
+
+	R operator()(Args... args) const {
+		return invoke_(const_cast<Storage*>(&storage_), std::forward<Args>(args)...);
+	}
+};
+
+#endif // INPLACEFUNCTION_HH
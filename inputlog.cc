@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "inputlog.hh"
+
+namespace {
+
+const char Signature[] = "opendaed-input-2";
+
+}
+
+InputRecorder::InputRecorder(const std::string& path, Clock::Time frequency, const std::string& startnod, int startentry, const std::string& puzzle) : stream_(path, std::ios_base::out | std::ios_base::trunc) {
+	if (!stream_.is_open())
+		throw std::runtime_error("cannot open input recording " + path);
+
+	stream_ << Signature << "\n";
+	stream_ << "start " << startnod << " " << startentry << " " << (puzzle.empty() ? "-" : puzzle) << "\n";
+	stream_ << "clock " << frequency << "\n";
+}
+
+InputRecorder::~InputRecorder() {
+	stream_ << "end\n";
+}
+
+void InputRecorder::BeginFrame(Clock::Time time) {
+	stream_ << "frame " << time << "\n";
+}
+
+void InputRecorder::Record(const SDL_Event& event) {
+	switch (event.type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		stream_ << (event.type == SDL_KEYDOWN ? "keydown " : "keyup ") << event.key.keysym.sym << " " << event.key.keysym.mod << "\n";
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		stream_ << (event.type == SDL_MOUSEBUTTONDOWN ? "mousedown " : "mouseup ") << (int)event.button.button << " " << event.button.x << " " << event.button.y << "\n";
+		break;
+	case SDL_MOUSEMOTION:
+		stream_ << "motion " << event.motion.x << " " << event.motion.y << " " << event.motion.state << "\n";
+		break;
+	case SDL_QUIT:
+		stream_ << "quit\n";
+		break;
+	default:
+		break;
+	}
+}
+
+InputReplayer::InputReplayer(const std::string& path) : stream_(path), startentry_(0), frequency_(0), next_type_(END), next_time_(0) {
+	if (!stream_.is_open())
+		throw std::runtime_error("cannot open input recording " + path);
+
+	std::string line;
+	if (!std::getline(stream_, line) || line != Signature)
+		throw std::runtime_error("bad input recording signature in " + path);
+
+	std::string keyword;
+	if (!std::getline(stream_, line) || !(std::istringstream(line) >> keyword >> startnod_ >> startentry_ >> puzzle_) || keyword != "start")
+		throw std::runtime_error("bad input recording start state in " + path);
+
+	if (puzzle_ == "-")
+		puzzle_.clear();
+
+	if (!std::getline(stream_, line) || !(std::istringstream(line) >> keyword >> frequency_) || keyword != "clock" || frequency_ == 0)
+		throw std::runtime_error("bad input recording clock frequency in " + path);
+
+	ReadNext();
+}
+
+InputReplayer::~InputReplayer() {
+}
+
+void InputReplayer::ReadNext() {
+	next_type_ = END;
+
+	// recording cut short (e.g. by a crash) just ends there
+	std::string line;
+	if (!std::getline(stream_, line))
+		return;
+
+	std::istringstream linestream(line);
+	std::string type;
+	if (!(linestream >> type))
+		throw std::runtime_error("bad input recording line: " + line);
+
+	memset(&next_event_, 0, sizeof(next_event_));
+
+	bool ok = true;
+	if (type == "frame") {
+		next_type_ = FRAME;
+		ok = !!(linestream >> next_time_);
+	} else if (type == "end") {
+		next_type_ = END;
+	} else {
+		next_type_ = EVENT;
+		if (type == "keydown" || type == "keyup") {
+			int sym, mod;
+			ok = !!(linestream >> sym >> mod);
+			next_event_.type = (type == "keydown") ? SDL_KEYDOWN : SDL_KEYUP;
+			next_event_.key.keysym.sym = sym;
+			next_event_.key.keysym.mod = mod;
+		} else if (type == "mousedown" || type == "mouseup") {
+			int button, x, y;
+			ok = !!(linestream >> button >> x >> y);
+			next_event_.type = (type == "mousedown") ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+			next_event_.button.button = button;
+			next_event_.button.x = x;
+			next_event_.button.y = y;
+		} else if (type == "motion") {
+			int x, y;
+			unsigned int state;
+			ok = !!(linestream >> x >> y >> state);
+			next_event_.type = SDL_MOUSEMOTION;
+			next_event_.motion.x = x;
+			next_event_.motion.y = y;
+			next_event_.motion.state = state;
+		} else if (type == "quit") {
+			next_event_.type = SDL_QUIT;
+		} else {
+			ok = false;
+		}
+	}
+
+	if (!ok)
+		throw std::runtime_error("bad input recording line: " + line);
+}
+
+const std::string& InputReplayer::GetStartNod() const {
+	return startnod_;
+}
+
+int InputReplayer::GetStartEntry() const {
+	return startentry_;
+}
+
+const std::string& InputReplayer::GetPuzzle() const {
+	return puzzle_;
+}
+
+Clock::Time InputReplayer::GetFrequency() const {
+	return frequency_;
+}
+
+bool InputReplayer::NextFrame(Clock::Time& time) {
+	// events not fetched in previous frame are dropped
+	while (next_type_ == EVENT)
+		ReadNext();
+
+	if (next_type_ != FRAME)
+		return false;
+
+	time = next_time_;
+	ReadNext();
+	return true;
+}
+
+bool InputReplayer::Poll(SDL_Event& event) {
+	if (next_type_ != EVENT)
+		return false;
+
+	event = next_event_;
+	ReadNext();
+	return true;
+}
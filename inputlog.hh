@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPUTLOG_HH
+#define INPUTLOG_HH
+
+#include <fstream>
+#include <string>
+
+#include <SDL2/SDL_events.h>
+
+#include "clock.hh"
+
+// Recording of user input for later replay
+//
+// Text file, with a signature line, a line with start state, a line
+// with game clock frequency, then a line per main loop iteration
+// with exact game time of that frame, each followed by lines of
+// input events processed in that frame:
+//
+//   opendaed-input-2
+//   start <nod file> <entry> <puzzle or ->
+//   clock <units per second>
+//   frame <time>
+//   keydown|keyup <keycode> <modifiers>
+//   mousedown|mouseup <button> <x> <y>
+//   motion <x> <y> <button state>
+//   quit
+//   end
+//
+// Replaying the same frame schedule with the same events in each
+// frame reproduces the session exactly. Only event types the game
+// reacts to are recorded.
+class InputRecorder {
+protected:
+	std::ofstream stream_;
+
+public:
+	InputRecorder(const std::string& path, Clock::Time frequency, const std::string& startnod, int startentry, const std::string& puzzle);
+	~InputRecorder();
+
+	void BeginFrame(Clock::Time time);
+	void Record(const SDL_Event& event);
+};
+
+class InputReplayer {
+protected:
+	enum LineType {
+		FRAME,
+		EVENT,
+		END,
+	};
+
+protected:
+	std::ifstream stream_;
+
+	std::string startnod_;
+	int startentry_;
+	std::string puzzle_;
+	Clock::Time frequency_;
+
+	// next line, read ahead
+	LineType next_type_;
+	Clock::Time next_time_;
+	SDL_Event next_event_;
+
+protected:
+	void ReadNext();
+
+public:
+	InputReplayer(const std::string& path);
+	~InputReplayer();
+
+	const std::string& GetStartNod() const;
+	int GetStartEntry() const;
+	const std::string& GetPuzzle() const;
+	Clock::Time GetFrequency() const;
+
+	// advance to next recorded frame; returns false if recording
+	// is over
+	bool NextFrame(Clock::Time& time);
+
+	// fetch next event of the current frame
+	bool Poll(SDL_Event& event);
+};
+
+#endif // INPUTLOG_HH
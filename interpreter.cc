@@ -18,101 +18,296 @@
  */
 
 #include <list>
+#include <set>
 #include <algorithm>
+#include <memory>
+#include <stdexcept>
 
 #include "logger.hh"
+#include "tracer.hh"
 
 #include "datamanager.hh"
 #include "movplayer.hh"
 #include "gameinterface.hh"
 #include "hotfile.hh"
+#include "readahead.hh"
 
 #include "interpreter.hh"
 
 namespace {
 
-static GameInterface::ControlEvent ConditionToEvent(int cond) {
+// how many movie clips ahead of current one to warm up, and
+// how much of each clip
+const int ReadAheadDepth = 2;
+const size_t ReadAheadBytesPerFile = 4 * 1024 * 1024;
+
+static bool ConditionToEvent(int cond, GameInterface::ControlEvent& event) {
 	switch (cond) {
-	case (int)NodFile::Condition::YES: return GameInterface::ControlEvent::YES;
-	case (int)NodFile::Condition::NO: return GameInterface::ControlEvent::NO;
-	case (int)NodFile::Condition::STARTUP: return GameInterface::ControlEvent::STARTUP;
-	case (int)NodFile::Condition::DIAGNOSTICS: return GameInterface::ControlEvent::DIAGNOSTICS;
-	case (int)NodFile::Condition::DEPLOY: return GameInterface::ControlEvent::DEPLOY;
-	case (int)NodFile::Condition::ANALYSIS: return GameInterface::ControlEvent::ANALYSIS;
-	case (int)NodFile::Condition::FLOODLIGHT: return GameInterface::ControlEvent::FLOODLIGHT;
+	case (int)NodFile::Condition::YES: event = GameInterface::ControlEvent::YES; return true;
+	case (int)NodFile::Condition::NO: event = GameInterface::ControlEvent::NO; return true;
+	case (int)NodFile::Condition::STARTUP: event = GameInterface::ControlEvent::STARTUP; return true;
+	case (int)NodFile::Condition::DIAGNOSTICS: event = GameInterface::ControlEvent::DIAGNOSTICS; return true;
+	case (int)NodFile::Condition::DEPLOY: event = GameInterface::ControlEvent::DEPLOY; return true;
+	case (int)NodFile::Condition::ANALYSIS: event = GameInterface::ControlEvent::ANALYSIS; return true;
+	case (int)NodFile::Condition::FLOODLIGHT: event = GameInterface::ControlEvent::FLOODLIGHT; return true;
 	default:
-		throw std::logic_error("condition type not implemented");
+		return false;
 	}
 }
 
 }
 
-Interpreter::Interpreter(const DataManager& data_manager, GameInterface& interface, MovPlayer& player, const std::string& startnod, int startentry) : data_manager_(data_manager), interface_(interface), player_(player), awaiting_event_(false) {
-	std::list<std::string> loading_queue;
-	loading_queue.push_back(startnod);
-
-	while (!loading_queue.empty()) {
-		Log("interp") << "loading script " << loading_queue.front();
-		NodFileMap::iterator just_added = nod_files_.emplace(loading_queue.front(), data_manager.GetPath(loading_queue.front())).first;
+Interpreter::Interpreter(const DataManager& data_manager, GameInterface& interface, MovPlayer& player, const std::string& startnod, int startentry) : exiting_(false), data_manager_(data_manager), interface_(interface), player_(player), readahead_(nullptr), hot_file_hits_(0), hot_file_misses_(0), awaiting_event_(false) {
+	// scripts are loaded on first use, but fail early if there's
+	// nothing to start with
+	if (!data_manager_.HasPath(startnod))
+		throw std::runtime_error("start nod file not found");
 
-		// collect all .nod files referenced by recently
-		// loaded one which were not yet visited
-		just_added->second.ForEach([this, &loading_queue](const NodFile::Entry& e) {
-				std::string file = e.GetName();
-				std::transform(file.begin(), file.end(), file.begin(), ::tolower);
-				if (file.rfind(".nod") == file.length() - 4 && file != "gate.nod" && nod_files_.find(file) == nod_files_.end())
-					loading_queue.push_back(file);
-			});
+	current_nod_name_ = startnod;
+	current_graph_ = nullptr;
+	current_node_ = startentry;
 
-		loading_queue.pop_front();
-	}
-
-	current_node_ = std::make_pair(startnod, startentry);
+	preload_thread_ = std::thread(&Interpreter::PreloadWorker, this);
 
 	interface_.SetListener(this);
 	player_.SetListener(this);
 }
 
 Interpreter::~Interpreter() {
+	{
+		std::lock_guard<std::mutex> lock(nod_files_mutex_);
+		exiting_ = true;
+	}
+	nod_files_cv_.notify_all();
+	preload_thread_.join();
+
+	Log(LogCategory::INTERP) << "hot file cache hits: " << hot_file_hits_ << ", misses: " << hot_file_misses_;
+
 	interface_.SetListener(nullptr);
 	player_.SetListener(nullptr);
 }
 
-void Interpreter::InterruptAndGoto(int offset) {
+const NodFile& Interpreter::GetNodFile(const std::string& name) {
+	std::unique_lock<std::mutex> lock(nod_files_mutex_);
+
+	// may be being loaded in background already
+	nod_files_cv_.wait(lock, [this, &name]() { return loading_nod_files_.find(name) == loading_nod_files_.end(); });
+
+	NodFileMap::iterator nodfile = nod_files_.find(name);
+	if (nodfile == nod_files_.end()) {
+		Log(LogCategory::INTERP) << "loading script " << name;
+
+		loading_nod_files_.insert(name);
+		lock.unlock();
+
+		try {
+			TraceSpan span("interp", "load script", name);
+			NodFile loaded(data_manager_.Load(name));
+			lock.lock();
+			nodfile = nod_files_.emplace(name, std::move(loaded)).first;
+		} catch (...) {
+			if (!lock.owns_lock())
+				lock.lock();
+			loading_nod_files_.erase(name);
+			nod_files_cv_.notify_all();
+			throw;
+		}
+
+		loading_nod_files_.erase(name);
+		nod_files_cv_.notify_all();
+	}
+
+	// script is in use now, so scripts it refers to are likely
+	// to be needed soon
+	if (requested_nod_files_.insert(name).second)
+		QueueReferencedNodFiles(nodfile->second);
+
+	return nodfile->second;
+}
+
+void Interpreter::QueueReferencedNodFiles(const NodFile& nodfile) {
+	// must be called with nod_files_mutex_ locked
+	nodfile.ForEach([this](const NodFile::Entry& e) {
+			std::string file = e.GetName();
+			std::transform(file.begin(), file.end(), file.begin(), ::tolower);
+			if (file.rfind(".nod") == file.length() - 4 && file != "gate.nod" && nod_files_.find(file) == nod_files_.end() &&
+					std::find(preload_queue_.begin(), preload_queue_.end(), file) == preload_queue_.end())
+				preload_queue_.push_back(file);
+		});
+
+	nod_files_cv_.notify_all();
+}
+
+void Interpreter::PreloadWorker() {
+	Tracer::SetThreadName("preload");
+
+	std::unique_lock<std::mutex> lock(nod_files_mutex_);
+	while (1) {
+		nod_files_cv_.wait(lock, [this]() { return exiting_ || !preload_queue_.empty(); });
+
+		if (exiting_)
+			return;
+
+		std::string name = preload_queue_.front();
+		preload_queue_.pop_front();
+
+		if (nod_files_.find(name) != nod_files_.end() || loading_nod_files_.find(name) != loading_nod_files_.end())
+			continue;
+
+		loading_nod_files_.insert(name);
+		lock.unlock();
+
+		// errors are not fatal here; if script is really needed,
+		// error will be reported when it's loaded on demand
+		std::unique_ptr<NodFile> loaded;
+		try {
+			TraceSpan span("interp", "preload script", name);
+			loaded.reset(new NodFile(data_manager_.Load(name, IoScheduler::Priority::PREFETCH)));
+		} catch (std::exception& e) {
+			Log(LogCategory::INTERP, LogLevel::WARNING) << "cannot preload script " << name << ": " << e.what();
+		}
+
+		lock.lock();
+
+		if (loaded) {
+			LOG(LogCategory::INTERP, LogLevel::DEBUG) << "preloaded script " << name;
+			nod_files_.emplace(name, std::move(*loaded));
+		}
+
+		loading_nod_files_.erase(name);
+		nod_files_cv_.notify_all();
+	}
+}
+
+const ScenarioGraph& Interpreter::GetGraph(const std::string& name) {
+	GraphMap::iterator graph = graphs_.find(name);
+	if (graph == graphs_.end()) {
+		const NodFile& nodfile = GetNodFile(name);
+		TraceSpan span("interp", "compile script", name);
+		graph = graphs_.emplace(name, ScenarioGraph(nodfile)).first;
+	}
+	return graph->second;
+}
+
+Interpreter::HotFilePtr Interpreter::GetHotFile(DataManager::FileId id) {
+	HotFileMap::iterator hotfile = hot_files_.find(id);
+	if (hotfile != hot_files_.end()) {
+		hot_file_hits_++;
+		return hotfile->second;
+	}
+
+	hot_file_misses_++;
+
+	TraceSpan span("interp", "load hot zones", data_manager_.GetFileInfo(id).name);
+	return hot_files_.emplace(id, std::make_shared<HotFile>(data_manager_.Load(id))).first->second;
+}
+
+void Interpreter::InterruptAndGoto(ScenarioGraph::NodeId target) {
 	if (!awaiting_event_)
 		return;
 
-	Log("interp") << "interrupt received";
+	LOG(LogCategory::INTERP, LogLevel::DEBUG) << "interrupt received";
 
 	player_.Stop();
 
-	current_node_.second += offset;
+	current_node_ = target;
 	awaiting_event_ = false;
 }
 
+void Interpreter::SetReadAhead(ReadAhead* readahead) {
+	readahead_ = readahead;
+}
+
+unsigned long Interpreter::GetHotFileHits() const {
+	return hot_file_hits_;
+}
+
+unsigned long Interpreter::GetHotFileMisses() const {
+	return hot_file_misses_;
+}
+
+void Interpreter::RequestReadAhead(const ScenarioGraph& graph, ScenarioGraph::NodeId start) {
+	if (readahead_ == nullptr)
+		return;
+
+	// previous hints are no longer relevant
+	readahead_->BeginHints();
+
+	// walk nodes reachable from the current one, nearest first;
+	// no-op entries are already skipped in the graph
+	std::set<ScenarioGraph::NodeId> visited;
+	std::list<std::pair<ScenarioGraph::NodeId, int>> queue;
+	queue.push_back(std::make_pair(start, 0));
+
+	bool out_of_budget = false;
+	while (!queue.empty() && !out_of_budget) {
+		ScenarioGraph::NodeId id = queue.front().first;
+		int depth = queue.front().second;
+		queue.pop_front();
+
+		if (id < 0 || id >= graph.GetNumNodes() || !visited.insert(id).second)
+			continue;
+
+		const ScenarioGraph::Node& node = graph.GetNode(id);
+
+		switch (node.entry->GetType()) {
+		case 2: case 61: case 3:
+			if (id != start) {
+				DataManager::FileId fileid = data_manager_.Lookup(node.entry->GetName());
+				// immediate successors are prefetched, anything
+				// further is only read when the drive is idle
+				IoScheduler::Priority priority = (depth == 0) ? IoScheduler::Priority::PREFETCH : IoScheduler::Priority::SPECULATIVE;
+				if (fileid != DataManager::INVALID_FILE_ID && !readahead_->Request(fileid, 0, ReadAheadBytesPerFile, priority))
+					out_of_budget = true;
+				depth++;
+			}
+			break;
+		default:
+			continue;
+		}
+
+		if (depth > ReadAheadDepth)
+			continue;
+
+		queue.push_back(std::make_pair(node.next, depth));
+		for (int i = 0; i < ScenarioGraph::MAX_CONDITIONS; i++)
+			queue.push_back(std::make_pair(node.rect_targets[i], depth));
+	}
+
+	readahead_->EndHints();
+}
+
 void Interpreter::Update() {
 	if (awaiting_event_)
 		return;
 
+	if (current_graph_ == nullptr)
+		current_graph_ = &GetGraph(current_nod_name_);
+
 	while (1) {
 		ResetHandlers();
 		interface_.ResetMode();
 
-		NodFileMap::const_iterator nodfile = nod_files_.find(current_node_.first);
-		if (nodfile == nod_files_.end())
-			throw std::logic_error("nod file not found"); // shouldn't happend as all files are preloaded in constructor
-		const NodFile::Entry* current_entry = &nodfile->second.GetEntry(current_node_.second);
-		Log("interp") << "interpreting entry " << current_node_.second << " from " << current_node_.first << ": type=" << current_entry->GetType();
+		const ScenarioGraph::Node& node = current_graph_->GetNode(current_node_);
+		const NodFile::Entry* current_entry = node.entry;
+
+		TraceSpan span("interp", "step", current_entry->GetName());
+		Log(LogCategory::INTERP) << "interpreting entry " << current_node_ << " from " << current_nod_name_ << ": type=" << current_entry->GetType();
 		switch (current_entry->GetType()) {
 		case 0: // death
 			{
-				Log("interp") << "  death: should exit to menu here, but it's not implemented yet";
+				Log(LogCategory::INTERP, LogLevel::WARNING) << "  death: should exit to menu here, but it's not implemented yet";
 				throw std::logic_error("death not implemented");
 			}
 		case 1: // no-op, mostly used by "gate" entries
+		case 5: // enable user interface (not implemented yet)
+		case 30: // something hotzone-related
+		case 33: // unknown
 			{
-				Log("interp") << "  nop, skipping";
-				current_node_.second += current_entry->GetDefaultOffset();
+				// only reachable as a starting entry, as no-op
+				// chains are skipped in the graph
+				LOG(LogCategory::INTERP, LogLevel::DEBUG) << "  nop, skipping";
+				current_node_ = node.next;
 				break;
 			}
 		case 2: // simple "play movie" command
@@ -125,30 +320,38 @@ void Interpreter::Update() {
 				int actionendframe = current_entry->GetActionEndFrame();
 
 				// install event handlers for this scene
-				for (auto& condition : current_entry->GetConditions()) {
-					Log("interp") << "  installing interface control handler: condition=" << condition.first;
-					AddControlEventHandler([=](GameInterface::ControlEvent event){
-							if (event == ConditionToEvent(condition.first) &&
-									player_.GetCurrentFrame() >= actionstartframe &&
+				for (int i = 0; i < node.num_conditions; i++) {
+					std::pair<int, ScenarioGraph::NodeId> condition = node.conditions[i];
+					GameInterface::ControlEvent event;
+					if (!ConditionToEvent(condition.first, event)) {
+						Log(LogCategory::INTERP, LogLevel::WARNING) << "  condition " << condition.first << " is not implemented, ignoring";
+						continue;
+					}
+					LOG(LogCategory::INTERP, LogLevel::DEBUG) << "  installing interface control handler: condition=" << condition.first;
+					ScenarioGraph::NodeId target = condition.second;
+					AddControlEventHandler(event, [=](){
+							if (player_.GetCurrentFrame() >= actionstartframe &&
 									player_.GetCurrentFrame() <= actionendframe)
-								InterruptAndGoto(condition.second);
+								InterruptAndGoto(target);
 						});
 				}
 
 				// install end of clip handler for this scene
-				int offset = current_entry->GetDefaultOffset();
+				ScenarioGraph::NodeId next = node.next;
 				AddEndOfClipEventHandler([=](){
-						InterruptAndGoto(offset);
+						InterruptAndGoto(next);
 					});
 
 				// play movie
-				Log("interp") << "  playing a movie";
+				LOG(LogCategory::INTERP, LogLevel::DEBUG) << "  playing a movie";
 				player_.Play(
 						data_manager_.GetPath(current_entry->GetName()),
 						current_entry->GetStartFrame(),
 						current_entry->GetEndFrame()
 					);
 
+				RequestReadAhead(*current_graph_, current_node_);
+
 				// yield
 				awaiting_event_ = true;
 				return;
@@ -156,69 +359,57 @@ void Interpreter::Update() {
 		case 3:
 			{
 				// install event handlers for this scene
-				for (auto& condition : current_entry->GetConditions()) {
-					Log("interp") << "  installing interface control handler: condition=" << condition.first;
-					AddControlEventHandler([=](GameInterface::ControlEvent event){
-							if (event == ConditionToEvent(condition.first))
-								InterruptAndGoto(condition.second);
+				for (int i = 0; i < node.num_conditions; i++) {
+					std::pair<int, ScenarioGraph::NodeId> condition = node.conditions[i];
+					GameInterface::ControlEvent event;
+					if (!ConditionToEvent(condition.first, event)) {
+						Log(LogCategory::INTERP, LogLevel::WARNING) << "  condition " << condition.first << " is not implemented, ignoring";
+						continue;
+					}
+					LOG(LogCategory::INTERP, LogLevel::DEBUG) << "  installing interface control handler: condition=" << condition.first;
+					ScenarioGraph::NodeId target = condition.second;
+					AddControlEventHandler(event, [=](){
+							InterruptAndGoto(target);
 						});
 				}
 
 				// check if we have a hot zone (is this correct?)
 				std::string hotname = current_entry->GetName();
 				hotname.replace(hotname.length() - 3, std::string::npos, "hot");
-				if (data_manager_.HasPath(hotname)) {
-					Log("interp") << "  found hotzone " << hotname;
-					HotFile hot(data_manager_.GetPath(hotname));
+				DataManager::FileId hotid = data_manager_.Lookup(hotname);
+				if (hotid != DataManager::INVALID_FILE_ID) {
+					LOG(LogCategory::INTERP, LogLevel::DEBUG) << "  found hotzone " << hotname;
+					HotFilePtr hot = GetHotFile(hotid);
 
-					std::vector<int> offsets_for_rect;
-
-					for (int i = 0; i < 8; i++)
-						offsets_for_rect.push_back(current_entry->GetCondition(i).second);
+					// graph nodes stay in place for the interpreter lifetime
+					const ScenarioGraph::NodeId* targets_for_rect = node.rect_targets;
 
 					AddPointEventHandler([=](const SDL2pp::Point& point) {
-							int nrect = 0;
-							for (auto& rect: hot.GetRectsForFrame(player_.GetCurrentFrame())) {
-								if (rect.Contains(point)) {
-									InterruptAndGoto(offsets_for_rect[nrect]);
-									return;
-								}
-								nrect++;
-							}
+							int nrect = hot->HitTest(player_.GetCurrentFrame(), point);
+							if (nrect != -1)
+								InterruptAndGoto(targets_for_rect[nrect]);
+						});
+
+					AddPointHoverEventHandler([=](const SDL2pp::Point& point) {
+							return hot->HitTest(player_.GetCurrentFrame(), point) != -1;
 						});
 
 					interface_.EnableLaserMode();
 				}
 
 				// play our single frame
-				Log("interp") << "  playing a single frame: ";
+				LOG(LogCategory::INTERP, LogLevel::DEBUG) << "  playing a single frame: ";
 				player_.PlaySingleFrame(
 						data_manager_.GetPath(current_entry->GetName()),
 						current_entry->GetStartFrame()
 					);
 
+				RequestReadAhead(*current_graph_, current_node_);
+
 				// yield
 				awaiting_event_ = true;
 				return;
 			}
-		case 5:
-			{
-				Log("interp") << "  enable user interface (not implemented yet)";
-				current_node_.second += current_entry->GetDefaultOffset();
-				break;
-			}
-		case 30:
-			{
-				Log("interp") << "  something hotzone-related, skipping";
-				current_node_.second += current_entry->GetDefaultOffset();
-				break;
-			}
-		case 33:
-			{
-				Log("interp") << "  unknown, skipping";
-				current_node_.second += current_entry->GetDefaultOffset();
-				break;
-			}
 		default:
 			throw std::logic_error("node type processing not implemented");
 		}
@@ -21,37 +21,81 @@
 #define INTERPRETER_HH
 
 #include <map>
+#include <memory>
+#include <set>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
+#include "datamanager.hh"
+#include "hotfile.hh"
 #include "nodfile.hh"
+#include "scenariograph.hh"
 #include "gameeventlistener.hh"
 
-class DataManager;
 class GameInterface;
 class MovPlayer;
+class ReadAhead;
 
 class Interpreter : private GameEventListener {
 protected:
 	typedef std::map<std::string, NodFile> NodFileMap;
-	typedef std::pair<std::string, int> NodPointer;
+	typedef std::map<std::string, ScenarioGraph> GraphMap;
+	typedef std::shared_ptr<const HotFile> HotFilePtr;
+	typedef std::map<DataManager::FileId, HotFilePtr> HotFileMap;
 
 protected:
+	// scripts are loaded on demand, and scripts referenced by
+	// the ones in use are loaded in background beforehand
+	std::mutex nod_files_mutex_;
+	std::condition_variable nod_files_cv_;
 	NodFileMap nod_files_;
+	std::set<std::string> loading_nod_files_;
+	std::set<std::string> requested_nod_files_;
+	std::list<std::string> preload_queue_;
+	bool exiting_;
+	std::thread preload_thread_;
 
 	const DataManager& data_manager_;
 	GameInterface& interface_;
 	MovPlayer& player_;
+	ReadAhead* readahead_;
 
-	NodPointer current_node_;
+	// compiled scripts; only used from the main thread
+	GraphMap graphs_;
+
+	// parsed hot zones, shared with point event handlers
+	HotFileMap hot_files_;
+	unsigned long hot_file_hits_;
+	unsigned long hot_file_misses_;
+
+	std::string current_nod_name_;
+	const ScenarioGraph* current_graph_;
+	ScenarioGraph::NodeId current_node_;
 
 	bool awaiting_event_;
 
 protected:
-	void InterruptAndGoto(int offset);
+	const NodFile& GetNodFile(const std::string& name);
+	void QueueReferencedNodFiles(const NodFile& nodfile);
+	void PreloadWorker();
+
+	const ScenarioGraph& GetGraph(const std::string& name);
+	HotFilePtr GetHotFile(DataManager::FileId id);
+
+	void InterruptAndGoto(ScenarioGraph::NodeId target);
+	void RequestReadAhead(const ScenarioGraph& graph, ScenarioGraph::NodeId start);
 
 public:
 	Interpreter(const DataManager& data_manager, GameInterface& interface, MovPlayer& player, const std::string& startnod, int numentry = 0);
 	virtual ~Interpreter();
 
+	void SetReadAhead(ReadAhead* readahead);
+
+	unsigned long GetHotFileHits() const;
+	unsigned long GetHotFileMisses() const;
+
 	void Update();
 };
 
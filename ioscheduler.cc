@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "logger.hh"
+#include "tracer.hh"
+
+#include "ioscheduler.hh"
+
+IoScheduler::IoScheduler()
+	: foreground_active_(false),
+	  exiting_(false),
+	  current_offset_(0),
+	  current_fd_(-1) {
+	for (auto& stats : stats_)
+		stats = Stats{ 0, 0, 0, 0, 0.0, 0.0 };
+
+	thread_ = std::thread(&IoScheduler::Worker, this);
+}
+
+IoScheduler::~IoScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		exiting_ = true;
+	}
+	worker_cv_.notify_all();
+	thread_.join();
+
+	if (current_fd_ != -1)
+		close(current_fd_);
+
+	static const char* names[NUM_PRIORITIES] = { "playback", "prefetch", "speculative" };
+	for (int i = 0; i < NUM_PRIORITIES; i++) {
+		const Stats& stats = stats_[i];
+		Log(LogCategory::IOSCHED) << names[i] << ": " << stats.requests << " requests (" << stats.merged << " merged), " << stats.bytes << " bytes, wait avg "
+			<< (stats.requests ? stats.total_wait_ms / stats.requests : 0.0) << " ms, max " << stats.max_wait_ms << " ms";
+	}
+}
+
+IoScheduler::RequestList::iterator IoScheduler::PickRequest() {
+	RequestList::iterator best = queue_.end();
+	off_t best_distance = 0;
+
+	for (RequestList::iterator request = queue_.begin(); request != queue_.end(); request++) {
+		if (foreground_active_ && (*request)->priority == Priority::SPECULATIVE)
+			continue;
+
+		// requests on the file we're already reading, in forward
+		// direction, don't require a seek; the rest are served in
+		// order of arrival
+		off_t distance = (*(*request)->path == current_path_ && (*request)->offset >= current_offset_)
+			? (*request)->offset - current_offset_
+			: std::numeric_limits<off_t>::max();
+
+		if (best == queue_.end() ||
+				(*request)->priority < (*best)->priority ||
+				((*request)->priority == (*best)->priority && distance < best_distance)) {
+			best = request;
+			best_distance = distance;
+		}
+	}
+
+	return best;
+}
+
+void IoScheduler::CollectBatch(Request* first) {
+	batch_.assign(1, first);
+
+	off_t end = first->offset + first->length;
+	size_t size = first->length;
+
+	// adjacent requests are usually chunks of the same background
+	// read issued by different threads, or neighbouring files in
+	// an archive or disc image
+	bool found = true;
+	while (found && batch_.size() < MAX_BATCH_REQUESTS) {
+		found = false;
+		for (RequestList::iterator request = queue_.begin(); request != queue_.end(); request++) {
+			if (foreground_active_ && (*request)->priority == Priority::SPECULATIVE)
+				continue;
+
+			if (*(*request)->path != *first->path || (*request)->offset != end || size + (*request)->length > MAX_BATCH_SIZE)
+				continue;
+
+			batch_.push_back(*request);
+			end += (*request)->length;
+			size += (*request)->length;
+			queue_.erase(request);
+			found = true;
+			break;
+		}
+	}
+}
+
+ssize_t IoScheduler::Execute() {
+	const Request& first = *batch_.front();
+
+	TraceSpan span("iosched", "read", *first.path);
+
+	if (current_fd_ == -1 || *first.path != current_path_) {
+		if (current_fd_ != -1)
+			close(current_fd_);
+
+		current_path_ = *first.path;
+		current_fd_ = open(current_path_.c_str(), O_RDONLY);
+		if (current_fd_ == -1)
+			return -1;
+	}
+
+	size_t length = 0;
+	for (auto& request : batch_)
+		length += request->length;
+
+	size_t total = 0;
+	while (total < length) {
+		// rebuild vector for the part not read yet
+		iovecs_.clear();
+		size_t skip = total;
+		for (auto& request : batch_) {
+			if (skip >= request->length) {
+				skip -= request->length;
+				continue;
+			}
+			iovecs_.push_back(iovec{ request->buffer + skip, request->length - skip });
+			skip = 0;
+		}
+
+		ssize_t nread = preadv(current_fd_, iovecs_.data(), iovecs_.size(), first.offset + total);
+		if (nread < 0)
+			return -1;
+		if (nread == 0)
+			break;
+		total += nread;
+	}
+
+	current_offset_ = first.offset + total;
+
+	return total;
+}
+
+void IoScheduler::Worker() {
+	Tracer::SetThreadName("iosched");
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (1) {
+		RequestList::iterator picked;
+		worker_cv_.wait(lock, [this, &picked]() {
+				return exiting_ || (picked = PickRequest()) != queue_.end();
+			});
+
+		if (exiting_)
+			break;
+
+		Request* first = *picked;
+		queue_.erase(picked);
+		CollectBatch(first);
+
+		Clock::time_point now = Clock::now();
+		for (auto& request : batch_) {
+			Stats& stats = stats_[(int)request->priority];
+			double wait_ms = std::chrono::duration<double, std::milli>(now - request->enqueued).count();
+			stats.requests++;
+			if (request != first)
+				stats.merged++;
+			stats.total_wait_ms += wait_ms;
+			stats.max_wait_ms = std::max(stats.max_wait_ms, wait_ms);
+		}
+
+		lock.unlock();
+		ssize_t total = Execute();
+		lock.lock();
+
+		// split the result between requests of the batch
+		size_t start = 0;
+		for (auto& request : batch_) {
+			if (total < 0)
+				request->result = -1;
+			else if ((size_t)total <= start)
+				request->result = 0;
+			else
+				request->result = std::min(request->length, (size_t)total - start);
+
+			if (request->result > 0)
+				stats_[(int)request->priority].bytes += request->result;
+
+			request->done = true;
+			start += request->length;
+		}
+		done_cv_.notify_all();
+	}
+
+	// fail anything left
+	for (auto& request : queue_) {
+		request->result = -1;
+		request->done = true;
+	}
+	queue_.clear();
+	done_cv_.notify_all();
+}
+
+ssize_t IoScheduler::ReadChunk(const std::string& path, off_t offset, size_t length, char* buffer, Priority priority) {
+	Request request = { &path, offset, length, buffer, priority, Clock::now(), false, 0, std::this_thread::get_id() };
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (exiting_ || aborted_threads_.find(request.thread) != aborted_threads_.end())
+		return -1;
+
+	queue_.push_back(&request);
+	worker_cv_.notify_one();
+
+	done_cv_.wait(lock, [&request]() { return request.done; });
+
+	return request.result;
+}
+
+ssize_t IoScheduler::Read(const std::string& path, off_t offset, size_t length, char* buffer, Priority priority) {
+	if (priority == Priority::PLAYBACK)
+		return ReadChunk(path, offset, length, buffer, priority);
+
+	size_t total = 0;
+	while (total < length) {
+		ssize_t nread = ReadChunk(path, offset + total, std::min<size_t>(length - total, BACKGROUND_CHUNK_SIZE), buffer + total, priority);
+		if (nread < 0)
+			return -1;
+		if (nread == 0)
+			break;
+		total += nread;
+	}
+
+	return total;
+}
+
+void IoScheduler::SetForegroundActive(bool active) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		foreground_active_ = active;
+	}
+	worker_cv_.notify_one();
+}
+
+void IoScheduler::Abort(std::thread::id thread) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		aborted_threads_.insert(thread);
+
+		for (RequestList::iterator request = queue_.begin(); request != queue_.end(); ) {
+			if ((*request)->thread == thread) {
+				(*request)->result = -1;
+				(*request)->done = true;
+				request = queue_.erase(request);
+			} else {
+				request++;
+			}
+		}
+	}
+	done_cv_.notify_all();
+}
+
+void IoScheduler::Resume(std::thread::id thread) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	aborted_threads_.erase(thread);
+}
+
+IoScheduler::Stats IoScheduler::GetStats(Priority priority) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	Stats stats = stats_[(int)priority];
+	stats.queue_depth = std::count_if(queue_.begin(), queue_.end(), [priority](const Request* request) {
+			return request->priority == priority;
+		});
+
+	return stats;
+}
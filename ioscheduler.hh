@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IOSCHEDULER_HH
+#define IOSCHEDULER_HH
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <string>
+#include <list>
+#include <set>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Serializes reads of data files through a single worker, so
+// reads from different parts of the game don't compete for a
+// single slow drive. Requests are served in priority order;
+// within a priority, the one closest to the current position
+// on the same file goes first. Background requests are split
+// into small chunks, so foreground request never waits for
+// more than one chunk. Queued requests which continue the picked
+// one on the same file are served by the same read.
+class IoScheduler {
+public:
+	enum class Priority {
+		PLAYBACK,    // data needed right now
+		PREFETCH,    // data for the next branch of the scenario
+		SPECULATIVE, // data which may be needed later
+	};
+
+	enum {
+		NUM_PRIORITIES = 3,
+	};
+
+	struct Stats {
+		size_t queue_depth;
+		unsigned long requests;
+		unsigned long merged; // requests served by other request's read
+		unsigned long long bytes;
+		double total_wait_ms;
+		double max_wait_ms;
+	};
+
+protected:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Request {
+		const std::string* path;
+		off_t offset;
+		size_t length;
+		char* buffer;
+		Priority priority;
+		Clock::time_point enqueued;
+		bool done;
+		ssize_t result;
+		std::thread::id thread;
+	};
+
+	typedef std::list<Request*> RequestList;
+
+	typedef std::vector<Request*> RequestBatch;
+
+	enum {
+		BACKGROUND_CHUNK_SIZE = 256 * 1024,
+
+		MAX_BATCH_SIZE = 1024 * 1024,
+		MAX_BATCH_REQUESTS = 16,
+	};
+
+protected:
+	std::mutex mutex_;
+	std::condition_variable worker_cv_;
+	std::condition_variable done_cv_;
+
+	RequestList queue_;
+	std::array<Stats, NUM_PRIORITIES> stats_;
+
+	bool foreground_active_;
+	bool exiting_;
+
+	std::set<std::thread::id> aborted_threads_;
+
+	// current position of the drive, as far as we know
+	std::string current_path_;
+	off_t current_offset_;
+	int current_fd_;
+
+	// worker only
+	RequestBatch batch_;
+	std::vector<struct iovec> iovecs_;
+
+	std::thread thread_;
+
+protected:
+	void Worker();
+	RequestList::iterator PickRequest();
+	void CollectBatch(Request* first);
+	ssize_t Execute();
+
+	ssize_t ReadChunk(const std::string& path, off_t offset, size_t length, char* buffer, Priority priority);
+
+public:
+	IoScheduler();
+	~IoScheduler();
+
+	// blocking read; returns number of bytes read, or -1 on error
+	ssize_t Read(const std::string& path, off_t offset, size_t length, char* buffer, Priority priority);
+
+	// while foreground streaming (e.g. movie playback, which reads
+	// its file directly) is active, speculative reads are held back
+	void SetForegroundActive(bool active);
+
+	// fail reads issued by given thread, both queued and later
+	// ones, so its owner can join it without waiting for a read
+	// which is held back; Resume() undoes that after the thread
+	// is joined, as its id may be reused
+	void Abort(std::thread::id thread);
+	void Resume(std::thread::id thread);
+
+	Stats GetStats(Priority priority);
+};
+
+#endif // IOSCHEDULER_HH
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+#include "isoimage.hh"
+
+namespace {
+
+const char VolumeDescriptorId[5] = { 'C', 'D', '0', '0', '1' };
+const char SyncPattern[12] = { 0x00, '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', 0x00 };
+
+enum {
+	PVD_SECTOR = 16,
+	PVD_ROOT_RECORD = 156,
+
+	RECORD_LENGTH = 0,
+	RECORD_EXTENT = 2,
+	RECORD_SIZE = 10,
+	RECORD_DATE = 18,
+	RECORD_FLAGS = 25,
+	RECORD_NAME_LENGTH = 32,
+	RECORD_NAME = 33,
+
+	FLAG_DIRECTORY = 0x02,
+
+	MAX_DEPTH = 8, // limit imposed by the standard
+};
+
+uint32_t Get32(const char* in) {
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++)
+		value |= (uint32_t)(unsigned char)in[i] << (i * 8);
+	return value;
+}
+
+void ReadSector(std::ifstream& stream, const IsoImage::Layout& layout, uint32_t sector, char* buffer) {
+	stream.seekg((uint64_t)sector * layout.sector_size + layout.sector_data_offset);
+	stream.read(buffer, IsoImage::SECTOR_DATA_SIZE);
+}
+
+bool IsVolumeDescriptor(std::ifstream& stream, const IsoImage::Layout& layout) {
+	char sector[IsoImage::SECTOR_DATA_SIZE];
+	ReadSector(stream, layout, PVD_SECTOR, sector);
+	return !stream.fail() && sector[0] == 1 && memcmp(sector + 1, VolumeDescriptorId, sizeof(VolumeDescriptorId)) == 0;
+}
+
+int64_t DecodeDate(const char* in) {
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = (unsigned char)in[0];
+	tm.tm_mon = (unsigned char)in[1] - 1;
+	tm.tm_mday = (unsigned char)in[2];
+	tm.tm_hour = (unsigned char)in[3];
+	tm.tm_min = (unsigned char)in[4];
+	tm.tm_sec = (unsigned char)in[5];
+
+	// last byte is offset from GMT in 15 minute intervals
+	return (int64_t)timegm(&tm) - (int64_t)(signed char)in[6] * 15 * 60;
+}
+
+std::string DecodeName(const char* in, size_t length) {
+	std::string name(in, length);
+
+	// strip version ("FOO.MOV;1") and empty extension ("FOO.")
+	size_t versionpos = name.find(';');
+	if (versionpos != std::string::npos)
+		name.erase(versionpos);
+	if (!name.empty() && name.back() == '.')
+		name.pop_back();
+
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+	return name;
+}
+
+void ReadDirectory(std::ifstream& stream, const IsoImage::Layout& layout, uint32_t sector, uint32_t size, int depth, std::set<uint32_t>& visited, IsoImage::EntryVector& entries) {
+	if (depth > MAX_DEPTH || !visited.insert(sector).second)
+		throw std::runtime_error("disc image directory structure is corrupt");
+
+	std::vector<std::pair<uint32_t, uint32_t>> subdirs;
+
+	char buffer[IsoImage::SECTOR_DATA_SIZE];
+	for (uint32_t offset = 0; offset < size; offset += IsoImage::SECTOR_DATA_SIZE) {
+		ReadSector(stream, layout, sector + offset / IsoImage::SECTOR_DATA_SIZE, buffer);
+
+		// records never cross sector boundary; rest of the sector
+		// after the last record is zero filled
+		size_t pos = 0;
+		while (pos < IsoImage::SECTOR_DATA_SIZE && buffer[pos + RECORD_LENGTH] != 0) {
+			const char* record = buffer + pos;
+			size_t record_length = (unsigned char)record[RECORD_LENGTH];
+			size_t name_length = (unsigned char)record[RECORD_NAME_LENGTH];
+			if (record_length < RECORD_NAME + name_length || pos + record_length > IsoImage::SECTOR_DATA_SIZE)
+				throw std::runtime_error("disc image directory record is corrupt");
+
+			pos += record_length;
+
+			// "." and ".." are encoded as single 0x00 and 0x01 bytes
+			if (name_length == 1 && (record[RECORD_NAME] == 0 || record[RECORD_NAME] == 1))
+				continue;
+
+			if (record[RECORD_FLAGS] & FLAG_DIRECTORY)
+				subdirs.push_back(std::make_pair(Get32(record + RECORD_EXTENT), Get32(record + RECORD_SIZE)));
+			else
+				entries.push_back({
+						DecodeName(record + RECORD_NAME, name_length),
+						Get32(record + RECORD_EXTENT),
+						Get32(record + RECORD_SIZE),
+						DecodeDate(record + RECORD_DATE)
+					});
+		}
+	}
+
+	for (auto& subdir : subdirs)
+		ReadDirectory(stream, layout, subdir.first, subdir.second, depth + 1, visited, entries);
+}
+
+}
+
+bool IsoImage::Detect(const std::string& path, Layout& layout) {
+	std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
+	if (!stream.is_open())
+		return false;
+
+	// raw image: each sector starts with sync pattern followed by
+	// address and mode; user data follows header (mode 1) or
+	// header and subheader (mode 2 form 1, CD-ROM XA)
+	char header[16];
+	stream.read(header, sizeof(header));
+	if (!stream.fail() && memcmp(header, SyncPattern, sizeof(SyncPattern)) == 0) {
+		layout = Layout{ RAW_SECTOR_SIZE, header[15] == 2 ? 24 : 16 };
+		return IsVolumeDescriptor(stream, layout);
+	}
+
+	stream.clear();
+	layout = Layout{ SECTOR_DATA_SIZE, 0 };
+	return IsVolumeDescriptor(stream, layout);
+}
+
+IsoImage::EntryVector IsoImage::ReadIndex(const std::string& path, const Layout& layout) {
+	std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
+	stream.exceptions(std::ifstream::badbit | std::ifstream::failbit);
+
+	char pvd[SECTOR_DATA_SIZE];
+	ReadSector(stream, layout, PVD_SECTOR, pvd);
+
+	const char* root = pvd + PVD_ROOT_RECORD;
+
+	EntryVector entries;
+	std::set<uint32_t> visited;
+	ReadDirectory(stream, layout, Get32(root + RECORD_EXTENT), Get32(root + RECORD_SIZE), 0, visited, entries);
+
+	return entries;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISOIMAGE_HH
+#define ISOIMAGE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ISO9660 disc image
+//
+// Both plain images (.iso, 2048 byte sectors) and raw images of
+// data tracks (.bin, 2352 byte sectors with sync pattern, header
+// and error correction data around user data) are supported.
+// Only primary volume descriptor is used (that is, no Joliet or
+// Rock Ridge extensions), which is enough for game discs.
+class IsoImage {
+public:
+	enum {
+		SECTOR_DATA_SIZE = 2048,
+		RAW_SECTOR_SIZE = 2352,
+	};
+
+	struct Layout {
+		int sector_size;        // size of sector in image file
+		int sector_data_offset; // offset of user data in sector
+	};
+
+	struct Entry {
+		std::string name;
+		uint32_t sector; // first sector of file extent
+		uint64_t size;
+		int64_t mtime;
+	};
+
+	typedef std::vector<Entry> EntryVector;
+
+public:
+	static bool Detect(const std::string& path, Layout& layout);
+	static EntryVector ReadIndex(const std::string& path, const Layout& layout);
+};
+
+#endif // ISOIMAGE_HH
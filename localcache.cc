@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "logger.hh"
+#include "tracer.hh"
+
+#include "localcache.hh"
+
+LocalCache::LocalCache(const DataManager& data_manager, IoScheduler& io_scheduler, const std::string& dir)
+	: data_manager_(data_manager),
+	  io_scheduler_(io_scheduler),
+	  dir_(dir),
+	  exiting_(false) {
+	if (mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST)
+		throw std::runtime_error("cannot create local cache directory");
+
+	thread_ = std::thread(&LocalCache::Worker, this);
+}
+
+LocalCache::~LocalCache() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		exiting_ = true;
+	}
+	worker_cv_.notify_all();
+
+	// see ReadAhead::~ReadAhead()
+	std::thread::id worker = thread_.get_id();
+	io_scheduler_.Abort(worker);
+	thread_.join();
+	io_scheduler_.Resume(worker);
+}
+
+void LocalCache::RaisePriority(DataManager::FileId id, IoScheduler::Priority priority) {
+	for (auto& request : queue_)
+		if (request.id == id && request.priority > priority)
+			request.priority = priority;
+
+	auto copying = copy_priorities_.find(id);
+	if (copying != copy_priorities_.end() && copying->second > priority)
+		copying->second = priority;
+}
+
+LocalCache::CopyRequest LocalCache::MakeRequest(DataManager::FileId id, const DataManager::FileInfo& info, IoScheduler::Priority priority) const {
+	return CopyRequest{ id, info.size, info.mtime, dir_ + "/" + info.name, priority };
+}
+
+const std::string* LocalCache::FindExisting(DataManager::FileId id, const DataManager::FileInfo& info) {
+	std::string path = dir_ + "/" + info.name;
+
+	// copies get mtime of the original, see Copy()
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size != info.size || st.st_mtime != info.mtime)
+		return nullptr;
+
+	states_[id] = COMPLETE;
+	return &(local_paths_[id] = path);
+}
+
+bool LocalCache::Copy(const CopyRequest& request, const CancelCallback& cancelled) {
+	TraceSpan span("localcache", "copy", request.target);
+
+	std::string tmppath = request.target + ".part";
+
+	std::vector<char> buffer(CHUNK_SIZE);
+
+	{
+		std::ofstream stream(tmppath, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+
+		off_t copied = 0;
+		while (copied < request.size) {
+			IoScheduler::Priority priority = request.priority;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (exiting_)
+					break;
+
+				auto copying = copy_priorities_.find(request.id);
+				if (copying != copy_priorities_.end())
+					priority = copying->second;
+			}
+
+			// someone waits for it, so it's not cancelled anymore
+			if (priority != IoScheduler::Priority::PLAYBACK && cancelled && cancelled())
+				break;
+
+			ssize_t nread = data_manager_.Read(request.id, copied, buffer.size(), buffer.data(), priority);
+			if (nread <= 0)
+				break;
+
+			stream.write(buffer.data(), nread);
+			copied += nread;
+		}
+
+		if (copied != request.size || stream.fail()) {
+			stream.close();
+			unlink(tmppath.c_str());
+			return false;
+		}
+	}
+
+	struct timeval times[2] = { { request.mtime, 0 }, { request.mtime, 0 } };
+	if (utimes(tmppath.c_str(), times) != 0 || rename(tmppath.c_str(), request.target.c_str()) != 0) {
+		unlink(tmppath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void LocalCache::Worker() {
+	Tracer::SetThreadName("localcache");
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (1) {
+		worker_cv_.wait(lock, [this]() { return exiting_ || !queue_.empty(); });
+
+		if (exiting_)
+			return;
+
+		// take most urgent request, oldest first
+		RequestQueue::iterator next = std::min_element(queue_.begin(), queue_.end(), [](const CopyRequest& a, const CopyRequest& b) {
+				return a.priority < b.priority;
+			});
+
+		CopyRequest request = *next;
+		queue_.erase(next);
+		copy_priorities_[request.id] = request.priority;
+
+		lock.unlock();
+		bool completed = Copy(request);
+		lock.lock();
+
+		copy_priorities_.erase(request.id);
+
+		if (completed) {
+			LOG(LogCategory::LOCALCACHE, LogLevel::DEBUG) << "cached " << request.target;
+			states_[request.id] = COMPLETE;
+			local_paths_[request.id] = request.target;
+		} else {
+			Log(LogCategory::LOCALCACHE, LogLevel::WARNING) << "cannot cache " << request.target;
+			states_[request.id] = FAILED;
+		}
+
+		done_cv_.notify_all();
+	}
+}
+
+const std::string* LocalCache::GetLocalPath(DataManager::FileId id, const DataManager::FileInfo& info, IoScheduler::Priority priority) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto state = states_.find(id);
+	if (state != states_.end()) {
+		if (state->second == COMPLETE)
+			return &local_paths_[id];
+
+		// file became more urgent since it was queued
+		if (state->second == COPYING)
+			RaisePriority(id, priority);
+
+		return nullptr;
+	}
+
+	if (const std::string* existing = FindExisting(id, info))
+		return existing;
+
+	queue_.push_back(MakeRequest(id, info, priority));
+	states_[id] = COPYING;
+	worker_cv_.notify_one();
+
+	return nullptr;
+}
+
+bool LocalCache::IsCached(DataManager::FileId id, const DataManager::FileInfo& info) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto state = states_.find(id);
+	if (state != states_.end())
+		return state->second == COMPLETE;
+
+	return FindExisting(id, info) != nullptr;
+}
+
+bool LocalCache::Fetch(DataManager::FileId id, const DataManager::FileInfo& info, IoScheduler::Priority priority, const CancelCallback& cancelled) {
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (1) {
+		auto state = states_.find(id);
+		if (state == states_.end()) {
+			if (FindExisting(id, info) != nullptr)
+				return true;
+			break;
+		} else if (state->second != COPYING) {
+			return state->second == COMPLETE;
+		}
+
+		// still queued: take it over from worker
+		RequestQueue::iterator queued = std::find_if(queue_.begin(), queue_.end(), [id](const CopyRequest& request) {
+				return request.id == id;
+			});
+
+		if (queued != queue_.end()) {
+			priority = std::min(priority, queued->priority);
+			queue_.erase(queued);
+			break;
+		}
+
+		// being copied by another thread: make it hurry if needed
+		// and wait for it
+		RaisePriority(id, priority);
+
+		if (cancelled && cancelled())
+			return false;
+
+		done_cv_.wait_for(lock, std::chrono::milliseconds(CANCEL_CHECK_MS));
+	}
+
+	states_[id] = COPYING;
+	copy_priorities_[id] = priority;
+
+	lock.unlock();
+	CopyRequest request = MakeRequest(id, info, priority);
+	bool completed = Copy(request, cancelled);
+	lock.lock();
+
+	copy_priorities_.erase(id);
+
+	if (completed) {
+		LOG(LogCategory::LOCALCACHE, LogLevel::DEBUG) << "cached " << request.target;
+		states_[id] = COMPLETE;
+		local_paths_[id] = request.target;
+	} else if (cancelled()) {
+		// forget it, so it's copied again when actually needed
+		states_.erase(id);
+	} else {
+		Log(LogCategory::LOCALCACHE, LogLevel::WARNING) << "cannot cache " << request.target;
+		states_[id] = FAILED;
+	}
+
+	done_cv_.notify_all();
+
+	return completed;
+}
+
+const std::string& LocalCache::Materialize(DataManager::FileId id, const DataManager::FileInfo& info) {
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (1) {
+		auto state = states_.find(id);
+		if (state == states_.end()) {
+			if (const std::string* existing = FindExisting(id, info))
+				return *existing;
+			break;
+		} else if (state->second == COMPLETE) {
+			return local_paths_[id];
+		} else if (state->second == FAILED) {
+			break;
+		}
+
+		// still queued: take it over from worker
+		RequestQueue::iterator queued = std::find_if(queue_.begin(), queue_.end(), [id](const CopyRequest& request) {
+				return request.id == id;
+			});
+
+		if (queued != queue_.end()) {
+			queue_.erase(queued);
+			break;
+		}
+
+		// being copied by another thread: make it hurry and wait
+		// for it
+		RaisePriority(id, IoScheduler::Priority::PLAYBACK);
+		done_cv_.wait(lock);
+	}
+
+	states_[id] = COPYING;
+	copy_priorities_[id] = IoScheduler::Priority::PLAYBACK;
+
+	LOG(LogCategory::LOCALCACHE, LogLevel::DEBUG) << "copying " << info.name << " from " << info.path;
+
+	lock.unlock();
+	bool completed = Copy(MakeRequest(id, info, IoScheduler::Priority::PLAYBACK));
+	lock.lock();
+
+	copy_priorities_.erase(id);
+
+	states_[id] = completed ? COMPLETE : FAILED;
+	done_cv_.notify_all();
+
+	if (!completed)
+		throw std::runtime_error("cannot copy data file to local cache");
+
+	return local_paths_[id] = dir_ + "/" + info.name;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOCALCACHE_HH
+#define LOCALCACHE_HH
+
+#include <sys/types.h>
+
+#include <string>
+#include <map>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "datamanager.hh"
+#include "ioscheduler.hh"
+
+// Copies data files from slow media (CD-ROM, network shares) into
+// a directory on local disk. Copies are made in background on first
+// use or on prefetch hint, and are reused on subsequent runs while
+// size and mtime of the original file are unchanged
+class LocalCache {
+protected:
+	enum State {
+		COPYING,
+		COMPLETE,
+		FAILED,
+	};
+
+	struct CopyRequest {
+		DataManager::FileId id;
+		off_t size;
+		time_t mtime;
+		std::string target;
+		IoScheduler::Priority priority;
+	};
+
+	typedef std::deque<CopyRequest> RequestQueue;
+
+	typedef std::function<bool()> CancelCallback;
+
+	enum {
+		CHUNK_SIZE = 1024 * 1024,
+
+		// cancellation isn't signalled, so it's polled while
+		// waiting for a copy made by another thread
+		CANCEL_CHECK_MS = 100,
+	};
+
+protected:
+	const DataManager& data_manager_;
+	IoScheduler& io_scheduler_;
+
+	std::string dir_;
+
+	std::mutex mutex_;
+	std::condition_variable worker_cv_;
+	std::condition_variable done_cv_;
+
+	std::map<DataManager::FileId, State> states_;
+	std::map<DataManager::FileId, std::string> local_paths_;
+	std::map<DataManager::FileId, IoScheduler::Priority> copy_priorities_; // of copies in progress; raised if someone waits for it
+	RequestQueue queue_;
+	bool exiting_;
+
+	std::thread thread_;
+
+protected:
+	void Worker();
+	bool Copy(const CopyRequest& request, const CancelCallback& cancelled = CancelCallback());
+
+	// makes queued or in-progress copy at least as urgent as given
+	// priority; must be called with mutex_ locked
+	void RaisePriority(DataManager::FileId id, IoScheduler::Priority priority);
+
+	CopyRequest MakeRequest(DataManager::FileId id, const DataManager::FileInfo& info, IoScheduler::Priority priority) const;
+
+	// checks for complete copy left from previous runs; must be
+	// called with mutex_ locked
+	const std::string* FindExisting(DataManager::FileId id, const DataManager::FileInfo& info);
+
+public:
+	LocalCache(const DataManager& data_manager, IoScheduler& io_scheduler, const std::string& dir);
+	~LocalCache();
+
+	// returns path to complete local copy of the file, or nullptr
+	// if there's none yet, in which case a copy is queued
+	const std::string* GetLocalPath(DataManager::FileId id, const DataManager::FileInfo& info, IoScheduler::Priority priority);
+
+	// returns true if complete local copy of the file exists
+	bool IsCached(DataManager::FileId id, const DataManager::FileInfo& info);
+
+	// makes local copy on the calling thread, or waits for it if
+	// it's being made by another thread; cancelled is checked
+	// between chunks, and cancelled copy may be requested again
+	// later; returns false if the copy failed or was cancelled
+	bool Fetch(DataManager::FileId id, const DataManager::FileInfo& info, IoScheduler::Priority priority, const CancelCallback& cancelled);
+
+	// returns path to local copy, making it synchronously if
+	// needed; used for files which cannot be used in-place, such
+	// as the ones in archives
+	const std::string& Materialize(DataManager::FileId id, const DataManager::FileInfo& info);
+};
+
+#endif // LOCALCACHE_HH
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2014 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "logger.hh"
+
+namespace {
+
+const char* CategoryNames[Logger::NUM_CATEGORIES] = {
+	"player",
+	"interp",
+	"datamgr",
+	"puzzle",
+	"texcache",
+	"readahead",
+	"iosched",
+	"localcache",
+	"trace",
+	"main",
+};
+
+const char* LevelNames[] = {
+	"off",
+	"error",
+	"warning",
+	"info",
+	"debug",
+};
+
+}
+
+std::atomic<int> Logger::levels_[Logger::NUM_CATEGORIES] = {
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+	{ (int)LogLevel::INFO },
+};
+
+Logger::Slot Logger::ring_[Logger::RING_SIZE];
+std::atomic<size_t> Logger::enqueue_pos_(0);
+size_t Logger::dequeue_pos_ = 0;
+std::atomic<unsigned long> Logger::dropped_(0);
+std::atomic<bool> Logger::running_(false);
+
+Logger::Logger() : exiting_(false) {
+	if (running_.load())
+		throw std::logic_error("only one logger may exist at a time");
+
+	for (size_t i = 0; i < RING_SIZE; i++)
+		ring_[i].sequence.store(enqueue_pos_.load() + i, std::memory_order_relaxed);
+	dequeue_pos_ = enqueue_pos_.load();
+
+	writer_thread_ = std::thread(&Logger::WriterWorker, this);
+
+	running_.store(true, std::memory_order_release);
+}
+
+Logger::~Logger() {
+	// from now on, messages are written directly
+	running_.store(false);
+
+	exiting_.store(true);
+	writer_thread_.join();
+}
+
+size_t Logger::FormatMessage(char* buffer, LogCategory category, const char* text, size_t length) {
+	int prefix = snprintf(buffer, 16, "[%8s] ", CategoryNames[(int)category]);
+	if (prefix < 0 || prefix >= 16)
+		prefix = 0;
+	memcpy(buffer + prefix, text, length);
+	buffer[prefix + length] = '\n';
+	return prefix + length + 1;
+}
+
+void Logger::SetLevel(LogCategory category, LogLevel level) {
+	levels_[(int)category].store((int)level, std::memory_order_relaxed);
+}
+
+void Logger::SetLevels(const std::string& spec) {
+	size_t start = 0;
+	while (start < spec.length()) {
+		size_t end = spec.find(',', start);
+		if (end == std::string::npos)
+			end = spec.length();
+
+		std::string item = spec.substr(start, end - start);
+		size_t eqpos = item.find('=');
+		if (eqpos == std::string::npos)
+			throw std::runtime_error("bad log level specification " + item + ", expected category=level");
+
+		std::string category = item.substr(0, eqpos);
+		std::string level = item.substr(eqpos + 1);
+
+		int nlevel = -1;
+		for (size_t i = 0; i < sizeof(LevelNames) / sizeof(LevelNames[0]); i++)
+			if (level == LevelNames[i])
+				nlevel = i;
+		if (nlevel == -1)
+			throw std::runtime_error("unknown log level " + level);
+
+		bool found = false;
+		for (int i = 0; i < NUM_CATEGORIES; i++) {
+			if (category == "all" || category == CategoryNames[i]) {
+				SetLevel((LogCategory)i, (LogLevel)nlevel);
+				found = true;
+			}
+		}
+		if (!found)
+			throw std::runtime_error("unknown log category " + category);
+
+		start = end + 1;
+	}
+}
+
+void Logger::Push(LogCategory category, const char* text, size_t length) {
+	if (!running_.load(std::memory_order_acquire)) {
+		char buffer[MESSAGE_SIZE + 16];
+		fwrite(buffer, FormatMessage(buffer, category, text, length), 1, stderr);
+		return;
+	}
+
+	// bounded multi-producer queue: claim a slot whose sequence
+	// matches enqueue position, fill it, then publish it by
+	// advancing its sequence for the consumer
+	size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+	Slot* slot;
+	while (1) {
+		slot = &ring_[pos & (RING_SIZE - 1)];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0) {
+			if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = enqueue_pos_.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->category = category;
+	slot->length = length;
+	memcpy(slot->text, text, length);
+	slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+size_t Logger::Drain() {
+	// gather as many messages as fit, and write them at once
+	char buffer[64 * 1024];
+	size_t used = 0;
+	size_t count = 0;
+
+	while (used + MESSAGE_SIZE + 16 <= sizeof(buffer)) {
+		Slot& slot = ring_[dequeue_pos_ & (RING_SIZE - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+			break;
+
+		used += FormatMessage(buffer + used, slot.category, slot.text, slot.length);
+
+		slot.sequence.store(dequeue_pos_ + RING_SIZE, std::memory_order_release);
+		dequeue_pos_++;
+		count++;
+	}
+
+	if (used > 0) {
+		fwrite(buffer, used, 1, stderr);
+		fflush(stderr);
+	}
+
+	return count;
+}
+
+void Logger::WriterWorker() {
+	unsigned long reported_dropped = 0;
+
+	while (1) {
+		bool exiting = exiting_.load();
+
+		size_t count = Drain();
+
+		unsigned long dropped = dropped_.load(std::memory_order_relaxed);
+		if (dropped != reported_dropped) {
+			fprintf(stderr, "[  logger] %lu messages dropped\n", dropped - reported_dropped);
+			reported_dropped = dropped;
+		}
+
+		// exiting flag is checked before draining, so everything
+		// pushed before destruction is written
+		if (count == 0 && exiting)
+			return;
+
+		if (count == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_SLEEP_MS));
+	}
+}
+
+void Log::Append(const char* data, size_t length) {
+	if (length > sizeof(buffer_) - length_)
+		length = sizeof(buffer_) - length_;
+	memcpy(buffer_ + length_, data, length);
+	length_ += length;
+}
+
+void Log::AppendFormatted(const char* format, ...) {
+	size_t avail = sizeof(buffer_) - length_;
+	if (avail == 0)
+		return;
+
+	va_list args;
+	va_start(args, format);
+	int res = vsnprintf(buffer_ + length_, avail, format, args);
+	va_end(args);
+
+	// on truncation, vsnprintf leaves room for terminating zero
+	if (res > 0)
+		length_ += ((size_t)res < avail) ? (size_t)res : avail - 1;
+}
+
+Log& Log::operator<<(const char* str) {
+	if (enabled_)
+		Append(str, strlen(str));
+	return *this;
+}
+
+Log& Log::operator<<(const std::string& str) {
+	if (enabled_)
+		Append(str.data(), str.length());
+	return *this;
+}
+
+Log& Log::operator<<(char value) {
+	if (enabled_)
+		Append(&value, 1);
+	return *this;
+}
+
+Log& Log::operator<<(bool value) {
+	if (enabled_)
+		AppendFormatted("%d", (int)value);
+	return *this;
+}
+
+Log& Log::operator<<(int value) {
+	if (enabled_)
+		AppendFormatted("%d", value);
+	return *this;
+}
+
+Log& Log::operator<<(unsigned int value) {
+	if (enabled_)
+		AppendFormatted("%u", value);
+	return *this;
+}
+
+Log& Log::operator<<(long value) {
+	if (enabled_)
+		AppendFormatted("%ld", value);
+	return *this;
+}
+
+Log& Log::operator<<(unsigned long value) {
+	if (enabled_)
+		AppendFormatted("%lu", value);
+	return *this;
+}
+
+Log& Log::operator<<(long long value) {
+	if (enabled_)
+		AppendFormatted("%lld", value);
+	return *this;
+}
+
+Log& Log::operator<<(unsigned long long value) {
+	if (enabled_)
+		AppendFormatted("%llu", value);
+	return *this;
+}
+
+Log& Log::operator<<(double value) {
+	if (enabled_)
+		AppendFormatted("%g", value);
+	return *this;
+}
+
+Log& Log::operator<<(const void* ptr) {
+	if (enabled_)
+		AppendFormatted("%p", ptr);
+	return *this;
+}
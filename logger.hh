@@ -20,48 +20,136 @@
 #ifndef LOGGER_HH
 #define LOGGER_HH
 
-#ifdef NDEBUG
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
 
-class Log {
+enum class LogCategory {
+	PLAYER,
+	INTERP,
+	DATAMGR,
+	PUZZLE,
+	TEXCACHE,
+	READAHEAD,
+	IOSCHED,
+	LOCALCACHE,
+	TRACE,
+	MAIN,
+};
+
+enum class LogLevel {
+	OFF,
+	ERROR,
+	WARNING,
+	INFO,
+	DEBUG,
+};
+
+// Log message sink
+//
+// Messages are formatted by Log objects on the stack and pushed
+// into a lock-free ring buffer, from which a background thread
+// writes them to stderr, so logging never waits for I/O. If the
+// ring is full, messages are dropped (and dropped ones counted).
+// While no Logger instance exists, messages are written directly.
+//
+// Each category has its own runtime level; a message above it is
+// rejected right in Log constructor, with a single comparison.
+class Logger {
 public:
-	Log(const char*) {
-	}
+	enum {
+		NUM_CATEGORIES = (int)LogCategory::MAIN + 1,
+		MESSAGE_SIZE = 240,
+	};
+
+protected:
+	enum {
+		RING_SIZE = 1024, // must be power of two
+		IDLE_SLEEP_MS = 5,
+	};
+
+	struct Slot {
+		std::atomic<size_t> sequence;
+		LogCategory category;
+		uint16_t length;
+		char text[MESSAGE_SIZE];
+	};
+
+protected:
+	static std::atomic<int> levels_[NUM_CATEGORIES];
+
+	static Slot ring_[RING_SIZE];
+	static std::atomic<size_t> enqueue_pos_;
+	static size_t dequeue_pos_;
+	static std::atomic<unsigned long> dropped_;
+	static std::atomic<bool> running_;
 
-	template<class T>
-	Log& operator<<(const T& t) {
-		return *this;
+protected:
+	std::atomic<bool> exiting_;
+	std::thread writer_thread_;
+
+protected:
+	static size_t FormatMessage(char* buffer, LogCategory category, const char* text, size_t length);
+	static size_t Drain();
+	void WriterWorker();
+
+public:
+	Logger();
+	~Logger();
+
+	static bool IsEnabled(LogCategory category, LogLevel level) {
+		return (int)level <= levels_[(int)category].load(std::memory_order_relaxed);
 	}
-};
 
-#else
+	static void SetLevel(LogCategory category, LogLevel level);
 
-#include <iostream>
-#include <iomanip>
-#include <sstream>
+	// parse and apply comma separated list of category=level pairs,
+	// where category may also be "all"
+	static void SetLevels(const std::string& spec);
+
+	static void Push(LogCategory category, const char* text, size_t length);
+};
 
 class Log {
 private:
-	const char* ident_;
-	std::stringstream stream_;
+	LogCategory category_;
+	bool enabled_;
+	size_t length_;
+	char buffer_[Logger::MESSAGE_SIZE];
+
+private:
+	void Append(const char* data, size_t length);
+	void AppendFormatted(const char* format, ...);
 
 public:
-	Log(const char* ident) : ident_(ident) {
+	Log(LogCategory category, LogLevel level = LogLevel::INFO) : category_(category), enabled_(Logger::IsEnabled(category, level)), length_(0) {
 	}
 
 	~Log() {
-		try {
-			std::cerr << "[" << std::setw(8) << ident_ << "] " << stream_.str() << std::endl;
-		} catch (...) {
-		}
+		if (enabled_)
+			Logger::Push(category_, buffer_, length_);
 	}
 
-	template<class T>
-	Log& operator<<(const T& t) {
-		stream_ << t;
-		return *this;
-	}
+	Log& operator<<(const char* str);
+	Log& operator<<(const std::string& str);
+	Log& operator<<(char value);
+	Log& operator<<(bool value);
+	Log& operator<<(int value);
+	Log& operator<<(unsigned int value);
+	Log& operator<<(long value);
+	Log& operator<<(unsigned long value);
+	Log& operator<<(long long value);
+	Log& operator<<(unsigned long long value);
+	Log& operator<<(double value);
+	Log& operator<<(const void* ptr);
 };
 
-#endif
+// Same as Log, but when the message is rejected, its arguments are
+// not even evaluated; meant for chatty debug messages, e.g. per file
+// or per script entry
+#define LOG(category, level) \
+	if (!Logger::IsEnabled(category, level)) ; else Log(category, level)
 
 #endif // LOGGER_HH
@@ -18,9 +18,11 @@
  */
 
 #include <getopt.h>
+#include <stdlib.h>
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <SDL2/SDL.h>
 
@@ -30,34 +32,79 @@
 #include <SDL2pp/Renderer.hh>
 #include <SDL2pp/Texture.hh>
 
+#include "clock.hh"
 #include "datamanager.hh"
 #include "gameinterface.hh"
+#include "inputlog.hh"
 #include "interpreter.hh"
 #include "movplayer.hh"
+#include "ioscheduler.hh"
+#include "localcache.hh"
+#include "logger.hh"
+#include "readahead.hh"
 #include "screen.hh"
+#include "texturecache.hh"
+#include "tracer.hh"
 
 #include "artemispuzzle.hh"
 #include "hexagonspuzzle.hh"
 #include "sunpuzzle.hh"
 
 void usage(const char* progname) {
-	std::cerr << "Usage: " << progname << " [ -n <start nodfile> ] [ -e <start nodfile entry> ] [ -p <puzzle name> ] -d <path to data directory>" << std::endl;
+	std::cerr << "Usage: " << progname << " [ -n <start nodfile> ] [ -e <start nodfile entry> ] [ -p <puzzle name> ] [ -b <texture cache budget, MiB> ] [ -i <index cache file> [ -I ] ] [ -j <scan threads> ] [ -a <read-ahead limit, MiB> ] [ -C <local cache directory> ] [ -s ] [ -V ] [ -l <category>=<level>[,...] ] [ -T <trace file> ] [ -R <input recording> | -P <input recording> ] [ -H ] [ -U ] [ -f <frame limit> ] [ -x <speed>[/<divisor>] ] -d <path to data directory>[@<priority>] [ -d ... ]" << std::endl;
 }
 
 int realmain(int argc, char** argv) {
 	const char* progname = argv[0];
 
-	const char* datapath = nullptr;
-	const char* startnod = "encountr.nod";
+	std::vector<std::pair<std::string, int>> datapaths;
+	bool probe_speed = false;
+	bool verify_duplicates = false;
+	std::string startnod = "encountr.nod";
 	int startentry = 2;
 
 	std::string puzzle;
 
+	size_t texture_budget = 64;
+
+	const char* index_cache = nullptr;
+	bool force_rescan = false;
+	int scan_threads = 0;
+
+	size_t readahead_limit = 32;
+
+	const char* local_cache_dir = nullptr;
+
+	const char* trace_file = nullptr;
+
+	const char* record_file = nullptr;
+	const char* replay_file = nullptr;
+
+	bool headless = false;
+	bool uncapped = false;
+	unsigned long frame_limit = 0;
+	unsigned int speed_num = 1;
+	unsigned int speed_den = 1;
+
 	int ch;
-	while ((ch = getopt(argc, argv, "d:n:e:p:h")) != -1) {
+	while ((ch = getopt(argc, argv, "d:n:e:p:b:i:Ij:a:C:l:T:R:P:HUf:x:sVh")) != -1) {
 		switch (ch) {
 		case 'd':
-			datapath = optarg;
+			{
+				// path@priority
+				std::string path = optarg;
+				size_t atpos = path.rfind('@');
+				if (atpos != std::string::npos && atpos + 1 < path.length() && path.find_first_not_of("-0123456789", atpos + 1) == std::string::npos)
+					datapaths.push_back(std::make_pair(path.substr(0, atpos), std::stoi(path.substr(atpos + 1))));
+				else
+					datapaths.push_back(std::make_pair(path, 0));
+			}
+			break;
+		case 's':
+			probe_speed = true;
+			break;
+		case 'V':
+			verify_duplicates = true;
 			break;
 		case 'n':
 			startnod = optarg;
@@ -69,6 +116,54 @@ int realmain(int argc, char** argv) {
 		case 'p':
 			puzzle = optarg;
 			break;
+		case 'b':
+			texture_budget = std::stoul(optarg);
+			break;
+		case 'i':
+			index_cache = optarg;
+			break;
+		case 'I':
+			force_rescan = true;
+			break;
+		case 'j':
+			scan_threads = std::stoi(optarg);
+			break;
+		case 'a':
+			readahead_limit = std::stoul(optarg);
+			break;
+		case 'C':
+			local_cache_dir = optarg;
+			break;
+		case 'l':
+			Logger::SetLevels(optarg);
+			break;
+		case 'T':
+			trace_file = optarg;
+			break;
+		case 'R':
+			record_file = optarg;
+			break;
+		case 'P':
+			replay_file = optarg;
+			break;
+		case 'H':
+			headless = true;
+			break;
+		case 'U':
+			uncapped = true;
+			break;
+		case 'f':
+			frame_limit = std::stoul(optarg);
+			break;
+		case 'x':
+			{
+				// speed[/divisor]
+				std::string speed = optarg;
+				size_t slashpos = speed.find('/');
+				speed_num = std::stoul(speed.substr(0, slashpos));
+				speed_den = (slashpos == std::string::npos) ? 1 : std::stoul(speed.substr(slashpos + 1));
+			}
+			break;
 		case 'h':
 			usage(progname);
 			return 0;
@@ -78,48 +173,164 @@ int realmain(int argc, char** argv) {
 		}
 	}
 
-	if (datapath == nullptr) {
+	if (datapaths.empty()) {
 		usage(progname);
 		return 1;
 	}
 
+	// Log messages are written to stderr by background thread
+	Logger logger;
+
+	// Trace spans, written to file on exit or by request
+	std::unique_ptr<Tracer> tracer;
+	if (trace_file) {
+		tracer.reset(new Tracer(trace_file));
+		Tracer::SetThreadName("main");
+	}
+
+	// Recorded input to replay, along with start state
+	std::unique_ptr<InputReplayer> replayer;
+	if (replay_file) {
+		replayer.reset(new InputReplayer(replay_file));
+		startnod = replayer->GetStartNod();
+		startentry = replayer->GetStartEntry();
+		puzzle = replayer->GetPuzzle();
+	}
+
+	// All reads from slow media are serialized through single scheduler
+	IoScheduler io_scheduler;
+
 	// Data manager
 	DataManager data_manager;
-	data_manager.ScanDir(datapath);
+	if (index_cache)
+		data_manager.SetIndexCache(index_cache, force_rescan);
+	if (scan_threads > 0)
+		data_manager.SetScanThreads(scan_threads);
+	data_manager.SetProbeSpeed(probe_speed);
+	data_manager.SetVerifyDuplicates(verify_duplicates);
+	for (auto& datapath : datapaths)
+		data_manager.ScanDir(datapath.first, datapath.second);
+	data_manager.SetIoScheduler(&io_scheduler);
 
-	// SDL stuff
-	SDL2pp::SDL sdl(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
-	SDL2pp::Window window("OpenDaed", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 640, 480, SDL_WINDOW_RESIZABLE);
-	SDL2pp::Renderer renderer(window, -1, SDL_RENDERER_ACCELERATED);
+	// Local copies of data from slow media
+	std::unique_ptr<LocalCache> local_cache;
+	if (local_cache_dir) {
+		local_cache.reset(new LocalCache(data_manager, io_scheduler, local_cache_dir));
+		data_manager.SetLocalCache(local_cache.get());
+	}
+
+	// SDL stuff; in headless mode, no display or audio device is
+	// needed: dummy video driver provides offscreen framebuffer for
+	// software renderer, and audio is decoded but not played
+	if (headless)
+		setenv("SDL_VIDEODRIVER", "dummy", 1);
+
+	SDL2pp::SDL sdl(headless ? SDL_INIT_VIDEO : SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+	SDL2pp::Window window("OpenDaed", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 640, 480, headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE);
+	SDL2pp::Renderer renderer(window, -1, headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED);
+
+	// Game time: constant during each frame, taken from wall clock or
+	// from replayed input, so recorded sessions replay exactly
+	SystemClock system_clock;
+	system_clock.SetSpeed(speed_num, speed_den);
+	VirtualClock clock(replayer ? replayer->GetFrequency() : system_clock.GetFrequency());
 
-	GameInterface interface(renderer, data_manager);
-	MovPlayer player;
+	std::unique_ptr<InputRecorder> recorder;
+	if (record_file)
+		recorder.reset(new InputRecorder(record_file, clock.GetFrequency(), startnod, startentry, puzzle));
+
+	TextureCache textures(renderer, data_manager, texture_budget * 1024 * 1024);
+
+	GameInterface interface(renderer, textures, clock);
+	MovPlayer player(clock);
+	player.SetIoScheduler(&io_scheduler);
+	player.SetNullAudio(headless);
 
 	// Script interpreter
 	Interpreter script(data_manager, interface, player, startnod, startentry);
 
+	// Background read-ahead of upcoming movies
+	std::unique_ptr<ReadAhead> readahead;
+	if (readahead_limit > 0) {
+		readahead.reset(new ReadAhead(data_manager, io_scheduler, readahead_limit * 1024 * 1024));
+		readahead->SetLocalCache(local_cache.get());
+		script.SetReadAhead(readahead.get());
+	}
+
 	// Screens that replace interface such as puzzles
 	std::unique_ptr<Screen> screen;
 
 	if (puzzle == "artemis")
-		screen.reset(new ArtemisPuzzle(renderer, data_manager));
+		screen.reset(new ArtemisPuzzle(renderer, textures, clock));
 	else if (puzzle == "hexagons")
-		screen.reset(new HexagonsPuzzle(renderer, data_manager));
+		screen.reset(new HexagonsPuzzle(renderer, textures));
 	else if (puzzle == "sun")
-		screen.reset(new SunPuzzle(renderer, data_manager));
+		screen.reset(new SunPuzzle(renderer, textures, clock));
+
+	// interface is not visible while screen is active
+	if (screen)
+		interface.ReleaseTextures();
+
+	FrameStats frame_stats;
+	unsigned long frames = 0;
 
 	while (1) {
-		unsigned int frame_ticks = SDL_GetTicks();
+		TraceSpan frame_span("main", "frame");
+		frame_stats.FrameStart();
 
-		// Process events
 		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
+
+		Clock::Time frame_time;
+		if (replayer) {
+			// real input is ignored while replaying, except for
+			// closing the window
+			while (SDL_PollEvent(&event))
+				if (event.type == SDL_QUIT)
+					return 0;
+
+			// same frames at the same game time as recorded
+			if (!replayer->NextFrame(frame_time)) {
+				Log(LogCategory::MAIN) << "replay finished";
+				return 0;
+			}
+
+			// unless uncapped, don't run ahead of (scaled) wall clock
+			if (!uncapped) {
+				unsigned int next = Clock::Rescale(frame_time, clock.GetFrequency(), 1000);
+				unsigned int wall = system_clock.GetTicks();
+				if (next > wall)
+					SDL_Delay(next - wall);
+			}
+		} else {
+			frame_time = system_clock.GetTime();
+		}
+
+		clock.SetTime(frame_time);
+		if (recorder)
+			recorder->BeginFrame(frame_time);
+
+		unsigned int frame_ticks = clock.GetTicks();
+
+		// Process events
+		while (replayer ? replayer->Poll(event) : SDL_PollEvent(&event)) {
+			if (recorder)
+				recorder->Record(event);
+
 			if (event.type == SDL_QUIT) {
 				return 0;
 			} else if (event.type == SDL_KEYDOWN) {
 				switch (event.key.keysym.sym) {
 				case SDLK_ESCAPE: case SDLK_q:
 					return 0;
+				case SDLK_F12:
+					if (tracer) {
+						try {
+							tracer->Export();
+						} catch (std::exception& e) {
+							Log(LogCategory::TRACE, LogLevel::ERROR) << "cannot write trace: " << e.what();
+						}
+					}
+					break;
 				}
 			}
 
@@ -151,10 +362,21 @@ int realmain(int argc, char** argv) {
 		else
 			interface.Render(player.GetTexture());
 
-		renderer.Present();
+		{
+			TraceSpan span("main", "present");
+			renderer.Present();
+		}
+
+		frame_stats.FrameEnd();
+
+		if (frame_limit > 0 && ++frames >= frame_limit) {
+			Log(LogCategory::MAIN) << "frame limit reached";
+			return 0;
+		}
 
 		// Frame limiter
-		SDL_Delay(1);
+		if (!uncapped)
+			SDL_Delay(1);
 	}
 
 	return 0;
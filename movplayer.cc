@@ -17,18 +17,20 @@
  * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <stdexcept>
 
-#include <SDL2/SDL_timer.h>
 #include <SDL2/SDL_render.h>
 
 #include <SDL2pp/AudioSpec.hh>
 
 #include "logger.hh"
+#include "ioscheduler.hh"
+#include "tracer.hh"
 
 #include "movplayer.hh"
 
-MovPlayer::MovPlayer() : state_(STOPPED), listener_(nullptr) {
+MovPlayer::MovPlayer(const Clock& clock) : null_audio_(false), null_audio_samples_(0), state_(STOPPED), start_time_(0), start_frame_(0), end_frame_(0), presented_frames_(0), skipped_frames_(0), total_lateness_us_(0), max_lateness_us_(0), listener_(nullptr), clock_(clock), io_scheduler_(nullptr) {
 }
 
 MovPlayer::~MovPlayer() {
@@ -38,6 +40,14 @@ void MovPlayer::SetListener(MovPlayer::EventListener* listener) {
 	listener_ = listener;
 }
 
+void MovPlayer::SetIoScheduler(IoScheduler* io_scheduler) {
+	io_scheduler_ = io_scheduler;
+}
+
+void MovPlayer::SetNullAudio(bool null_audio) {
+	null_audio_ = null_audio;
+}
+
 void MovPlayer::UpdateMovieFile(const std::string& filename, bool need_audio) {
 	has_audio_ = false;
 	if (filename != current_file_ || qt_.get() == nullptr) {
@@ -80,11 +90,14 @@ void MovPlayer::UpdateFrameTexture(SDL2pp::Renderer& renderer, int frame) {
 			texture_->GetFormat() != SDL_PIXELFORMAT_RGB24 ||
 			texture_->GetAccess() != SDL_TEXTUREACCESS_STREAMING ||
 			texture_->GetWidth() != width ||
-			texture_->GetHeight() != height)
+			texture_->GetHeight() != height) {
+		TraceSpan span("player", "create texture");
 		texture_.reset(new SDL2pp::Texture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING, width, height));
+	}
 
 	// decode next frame
 	{
+		TraceSpan span("player", "update texture");
 		SDL2pp::Texture::LockHandle lock = texture_->Lock(SDL2pp::NullOpt);
 		qt_->DecodeVideo(static_cast<unsigned char*>(lock.GetPixels()), lock.GetPitch());
 	}
@@ -93,10 +106,19 @@ void MovPlayer::UpdateFrameTexture(SDL2pp::Renderer& renderer, int frame) {
 }
 
 void MovPlayer::ResetPlayback() {
+	if (state_ == PLAYING)
+		ReportPresentation();
+
 	start_frame_ = end_frame_ = 0;
-	start_frame_ticks_ = 0;
+	start_time_ = 0;
 	state_ = STOPPED;
 	audio_.reset(nullptr);
+	SetStreaming(false);
+}
+
+void MovPlayer::SetStreaming(bool streaming) {
+	if (io_scheduler_)
+		io_scheduler_->SetForegroundActive(streaming);
 }
 
 void MovPlayer::EmitEndOfClipEvent() {
@@ -104,24 +126,66 @@ void MovPlayer::EmitEndOfClipEvent() {
 		listener_->ProcessEndOfClipEvent();
 }
 
+void MovPlayer::ConsumeNullAudio(Clock::Time elapsed) {
+	// decode and discard samples which would have been played by
+	// now, so audio decoding load is the same as with real device
+	int64_t due = (int64_t)Clock::Rescale(elapsed, clock_.GetFrequency(), qt_->GetSampleRate());
+
+	while (null_audio_samples_ < due) {
+		long chunk = (long)std::min<int64_t>(due - null_audio_samples_, NULL_AUDIO_CHUNK);
+		null_audio_buffer_.resize(chunk * qt_->GetTrackChannels());
+		qt_->DecodeAudioRaw(null_audio_buffer_.data(), chunk);
+		null_audio_samples_ += chunk;
+	}
+}
+
+void MovPlayer::AccountPresentation(int previous_frame, Clock::Time elapsed) {
+	// ideal time of the frame relative to playback start, in
+	// movie time scale
+	int64_t ideal = (int64_t)(current_frame_ - start_frame_ + qt_->GetVideoPtsOffset() / qt_->GetFrameDuration()) * qt_->GetFrameDuration();
+	if (ideal < 0)
+		return;
+
+	uint64_t elapsed_us = Clock::Rescale(elapsed, clock_.GetFrequency(), 1000000);
+	uint64_t ideal_us = Clock::Rescale((uint64_t)ideal, qt_->GetTimeScale(), 1000000);
+	uint64_t lateness_us = elapsed_us > ideal_us ? elapsed_us - ideal_us : 0;
+
+	presented_frames_++;
+	if (previous_frame >= 0 && current_frame_ > previous_frame + 1)
+		skipped_frames_ += current_frame_ - previous_frame - 1;
+	total_lateness_us_ += lateness_us;
+	max_lateness_us_ = std::max(max_lateness_us_, lateness_us);
+}
+
+void MovPlayer::ReportPresentation() {
+	if (presented_frames_ > 0) {
+		Log(LogCategory::PLAYER) << "presented " << presented_frames_ << " frames, " << skipped_frames_ << " skipped, lateness avg "
+			<< total_lateness_us_ / presented_frames_ << " us, max " << max_lateness_us_ << " us";
+	}
+
+	presented_frames_ = skipped_frames_ = 0;
+	total_lateness_us_ = max_lateness_us_ = 0;
+}
+
 void MovPlayer::Play(const std::string& filename, int startframe, int endframe) {
-	Log("player") << "playing " << filename << " at [" << startframe << ".." << endframe << "]";
+	TraceSpan span("player", "play", filename);
+	Log(LogCategory::PLAYER) << "playing " << filename << " at [" << startframe << ".." << endframe << "]";
 
 	ResetPlayback();
 
 	UpdateMovieFile(filename, true);
 
 	// print some info
-	Log("player") << "  video:";
-	Log("player") << "    dimensions: " << qt_->GetWidth() << "x" << qt_->GetHeight();
-	Log("player") << "    time scale: " << qt_->GetTimeScale();
-	Log("player") << "    frame dur.: " << qt_->GetFrameDuration();
-	Log("player") << "    frame rate: " << (float)qt_->GetTimeScale() / (float)qt_->GetFrameDuration() << " fps";
-	Log("player") << "    pts offset: " << qt_->GetVideoPtsOffset() << " (" << (float)qt_->GetVideoPtsOffset() / (float)qt_->GetFrameDuration() << " frames)";
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "  video:";
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    dimensions: " << qt_->GetWidth() << "x" << qt_->GetHeight();
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    time scale: " << qt_->GetTimeScale();
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    frame dur.: " << qt_->GetFrameDuration();
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    frame rate: " << (float)qt_->GetTimeScale() / (float)qt_->GetFrameDuration() << " fps";
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    pts offset: " << qt_->GetVideoPtsOffset() << " (" << (float)qt_->GetVideoPtsOffset() / (float)qt_->GetFrameDuration() << " frames)";
 
 	if (has_audio_) {
-		Log("player") << "  audio:";
-		Log("player") << "    sample rate: " << qt_->GetSampleRate();
+		LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "  audio:";
+		LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    sample rate: " << qt_->GetSampleRate();
 		std::string format = "unknown";
 		switch (qt_->GetSampleFormat()) {
 		case LQT_SAMPLE_INT8: format = "s8"; break;
@@ -132,10 +196,10 @@ void MovPlayer::Play(const std::string& filename, int startframe, int endframe)
 		case LQT_SAMPLE_DOUBLE: format = "double"; break;
 		default: break;
 		}
-		Log("player") << "    sample format: " << format;
-		Log("player") << "    audio bits: " << qt_->GetAudioBits();
-		Log("player") << "    channels: " << qt_->GetTrackChannels();
-		Log("player") << "    pts offset: " << qt_->GetAudioPtsOffset() << " samples";
+		LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    sample format: " << format;
+		LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    audio bits: " << qt_->GetAudioBits();
+		LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    channels: " << qt_->GetTrackChannels();
+		LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    pts offset: " << qt_->GetAudioPtsOffset() << " samples";
 	}
 
 	// setup video timing
@@ -144,34 +208,40 @@ void MovPlayer::Play(const std::string& filename, int startframe, int endframe)
 
 	// setup audio
 	if (has_audio_) {
-		SDL2pp::AudioSpec spec(qt_->GetSampleRate(), AUDIO_U8, qt_->GetTrackChannels(), 16);
-		audio_.reset(new SDL2pp::AudioDevice(SDL2pp::NullOpt, false, spec,
-				[this](Uint8* stream, int len) {
-					qt_->DecodeAudioRaw(stream, len / qt_->GetTrackChannels());
-				}
-			));
+		if (!null_audio_) {
+			SDL2pp::AudioSpec spec(qt_->GetSampleRate(), AUDIO_U8, qt_->GetTrackChannels(), 16);
+			audio_.reset(new SDL2pp::AudioDevice(SDL2pp::NullOpt, false, spec,
+					[this](Uint8* stream, int len) {
+						qt_->DecodeAudioRaw(stream, len / qt_->GetTrackChannels());
+					}
+				));
+		}
 
 		int audiopos = (int)((float)start_frame_ * (float)qt_->GetFrameDuration() / (float)qt_->GetTimeScale() * qt_->GetSampleRate());
 		qt_->SetAudioPosition(audiopos);
+		null_audio_samples_ = 0;
 
-		audio_->Pause(false);
+		if (audio_.get())
+			audio_->Pause(false);
 	}
 
-	start_frame_ticks_ = SDL_GetTicks();
+	start_time_ = clock_.GetTime();
 
 	state_ = PLAYING;
+	SetStreaming(true);
 }
 
 void MovPlayer::PlaySingleFrame(const std::string& filename, int frame) {
-	Log("player") << "playing " << filename << " single frame " << frame;
+	TraceSpan span("player", "play single frame", filename);
+	Log(LogCategory::PLAYER) << "playing " << filename << " single frame " << frame;
 
 	ResetPlayback();
 
 	UpdateMovieFile(filename, false);
 
 	// print some info
-	Log("player") << "  video:";
-	Log("player") << "    dimensions: " << qt_->GetWidth() << "x" << qt_->GetHeight();
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "  video:";
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "    dimensions: " << qt_->GetWidth() << "x" << qt_->GetHeight();
 
 	start_frame_ = frame;
 
@@ -179,8 +249,11 @@ void MovPlayer::PlaySingleFrame(const std::string& filename, int frame) {
 }
 
 void MovPlayer::Stop() {
-	Log("player") << "stopping";
+	LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "stopping";
+	if (state_ == PLAYING)
+		ReportPresentation();
 	state_ = STOPPED;
+	SetStreaming(false);
 }
 
 bool MovPlayer::UpdateFrame(SDL2pp::Renderer& renderer) {
@@ -188,12 +261,21 @@ bool MovPlayer::UpdateFrame(SDL2pp::Renderer& renderer) {
 	if (!qt_.get())
 		return false;
 
+	TraceSpan span("player", "update frame");
+
 	// ensure audio callback is not called while processing this frame
 	SDL2pp::AudioDevice::LockHandle lock;
-	if (has_audio_)
+	if (audio_.get())
 		lock = audio_->Lock();
 
-	// calculate wanted frame from given time
+	Clock::Time elapsed = clock_.GetTime() - start_time_;
+
+	if (has_audio_ && !audio_.get() && state_ == PLAYING)
+		ConsumeNullAudio(elapsed);
+
+	// calculate wanted frame from given time; conversion to movie
+	// time scale is done from clock units directly, so frame
+	// boundaries are exact
 	int wanted_frame;
 	switch (state_) {
 	case STOPPED:
@@ -201,7 +283,7 @@ bool MovPlayer::UpdateFrame(SDL2pp::Renderer& renderer) {
 		break;
 	case PLAYING:
 		wanted_frame = start_frame_ +
-			(SDL_GetTicks() - start_frame_ticks_) * qt_->GetTimeScale() / (qt_->GetFrameDuration() * 1000) -
+			(int)(Clock::Rescale(elapsed, clock_.GetFrequency(), qt_->GetTimeScale()) / qt_->GetFrameDuration()) -
 			qt_->GetVideoPtsOffset() / qt_->GetFrameDuration();
 		if (wanted_frame > end_frame_)
 			wanted_frame = end_frame_;
@@ -215,14 +297,21 @@ bool MovPlayer::UpdateFrame(SDL2pp::Renderer& renderer) {
 	if (wanted_frame < 0)
 		wanted_frame = 0;
 
+	int previous_frame = current_frame_;
+
 	UpdateFrameTexture(renderer, wanted_frame);
 
 	if (state_ == PLAYING) {
+		if (current_frame_ != previous_frame)
+			AccountPresentation(previous_frame, elapsed);
+
 		if (current_frame_ >= end_frame_) {
-			Log("player") << "movie finished";
+			LOG(LogCategory::PLAYER, LogLevel::DEBUG) << "movie finished";
+			ReportPresentation();
 			if (audio_.get())
 				audio_->Pause(true);
 			state_ = STOPPED;
+			SetStreaming(false);
 			EmitEndOfClipEvent();
 		}
 	}
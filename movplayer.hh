@@ -23,13 +23,17 @@
 #include <string>
 #include <memory>
 #include <functional>
+#include <vector>
 
 #include <SDL2pp/Renderer.hh>
 #include <SDL2pp/Texture.hh>
 #include <SDL2pp/AudioDevice.hh>
 
+#include "clock.hh"
 #include "quicktime.hh"
 
+class IoScheduler;
+
 class MovPlayer {
 public:
 	class EventListener {
@@ -48,12 +52,23 @@ protected:
 		SINGLE_FRAME,
 	};
 
+	enum {
+		// max samples decoded by null audio sink at once
+		NULL_AUDIO_CHUNK = 4096,
+	};
+
 protected:
 	std::unique_ptr<QuickTime> qt_;
 
 	std::unique_ptr<SDL2pp::Texture> texture_;
 	std::unique_ptr<SDL2pp::AudioDevice> audio_;
 
+	// when set, audio is decoded and discarded instead of being
+	// played through audio device
+	bool null_audio_;
+	int64_t null_audio_samples_;
+	std::vector<unsigned char> null_audio_buffer_;
+
 	// state of the currently loaded movie clip
 	std::string current_file_;
 	bool has_audio_;
@@ -62,25 +77,46 @@ protected:
 
 	// state of the player
 	State state_;
-	unsigned int start_frame_ticks_;
+	Clock::Time start_time_;
 	int start_frame_;
 	int end_frame_;
 
+	// presentation timing of the current clip: how late frames were
+	// shown relative to their ideal times, and how many were skipped
+	unsigned long presented_frames_;
+	unsigned long skipped_frames_;
+	uint64_t total_lateness_us_;
+	uint64_t max_lateness_us_;
+
 	EventListener* listener_;
 
+	const Clock& clock_;
+	IoScheduler* io_scheduler_;
+
 protected:
 	void UpdateMovieFile(const std::string& name, bool need_audio);
 	void UpdateFrameTexture(SDL2pp::Renderer& renderer, int frame);
 
 	void ResetPlayback();
 
+	// movie data is read by libquicktime directly, so just let
+	// I/O scheduler know that the drive is busy with streaming
+	void SetStreaming(bool streaming);
+
 	void EmitEndOfClipEvent();
 
+	void ConsumeNullAudio(Clock::Time elapsed);
+
+	void AccountPresentation(int previous_frame, Clock::Time elapsed);
+	void ReportPresentation();
+
 public:
-	MovPlayer();
+	MovPlayer(const Clock& clock);
 	~MovPlayer();
 
 	void SetListener(EventListener* listener);
+	void SetIoScheduler(IoScheduler* io_scheduler);
+	void SetNullAudio(bool null_audio);
 
 	void Play(const std::string& filename, int startframe, int endframe);
 	void PlaySingleFrame(const std::string& filename, int frame);
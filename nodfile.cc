@@ -17,45 +17,149 @@
  * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
-
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "textscanner.hh"
 
 #include "nodfile.hh"
 
-NodFile::NodFile(const std::string& path) {
-	std::ifstream stream(path, std::ios_base::in);
-	stream.exceptions(std::ifstream::badbit);
+namespace {
+
+const char Signature[8] = { 'O', 'D', 'N', 'O', 'D', 'V', '0', '1' };
+const uint32_t ByteOrderMark = 0x01020304;
+
+struct Header {
+	char signature[8];
+	uint32_t byte_order;
+	uint32_t num_entries;
+};
+
+static_assert(sizeof(NodFile::Entry) == 26 * 4, "unexpected padding in NodFile::Entry");
+
+}
+
+NodFile::NodFile(const std::string& path) : NodFile(FileBuffer(path)) {
+}
+
+NodFile::NodFile(FileBuffer&& data) : entries_(nullptr), num_entries_(0) {
+	if (data.GetSize() >= sizeof(Signature) && memcmp(data.GetData(), Signature, sizeof(Signature)) == 0)
+		Attach(std::move(data));
+	else
+		Parse(data.GetData(), data.GetSize());
+}
+
+void NodFile::Parse(const char* data, size_t size) {
+	// records are collected with name offsets relative to pool
+	// start, and fixed up when the image is built
+	std::vector<int32_t> records;
+	std::string pool;
+
+	TextScanner scanner(data, size);
 
 	int index = 0;
-	while (!stream.eof()) {
-		Entry e;
-		stream >> e.number >> e.name;
+	while (1) {
+		int32_t record[26];
+		const char* name;
+		size_t name_length;
 
-		for (int i = 0; i < 24; i++)
-			stream >> e.fields[i];
+		if (!scanner.ReadInt(record[0]) || !scanner.ReadWord(name, name_length))
+			break;
+
+		int nfield = 0;
+		while (nfield < 24 && scanner.ReadInt(record[2 + nfield]))
+			nfield++;
 
-		if (stream.fail())
+		if (nfield != 24)
 			break;
 
-		if (index != e.number)
+		if (index != record[0])
 			throw std::runtime_error("entry index in file != real index, this is unexpected");
 
-		entries_.push_back(std::move(e));
+		record[1] = pool.length();
+		pool.append(name, name_length);
+		pool.push_back('\0');
+
+		records.insert(records.end(), record, record + 26);
 
 		index++;
 	}
+
+	// build binary image
+	size_t num_entries = records.size() / 26;
+	size_t pool_offset = sizeof(Header) + num_entries * sizeof(Entry);
+
+	Header header;
+	memcpy(header.signature, Signature, sizeof(Signature));
+	header.byte_order = ByteOrderMark;
+	header.num_entries = num_entries;
+
+	for (size_t i = 0; i < num_entries; i++)
+		records[i * 26 + 1] += pool_offset - (sizeof(Header) + i * sizeof(Entry));
+
+	std::vector<char> image(pool_offset + pool.length());
+	memcpy(image.data(), &header, sizeof(header));
+	if (!records.empty())
+		memcpy(image.data() + sizeof(Header), records.data(), records.size() * sizeof(int32_t));
+	std::copy(pool.begin(), pool.end(), image.begin() + pool_offset);
+
+	Attach(FileBuffer(std::move(image)));
+}
+
+void NodFile::Attach(FileBuffer&& image) {
+	// mapped data may be misaligned if it comes from an archive
+	// packed with unusual alignment
+	if (reinterpret_cast<uintptr_t>(image.GetData()) % alignof(Entry) != 0)
+		image = FileBuffer(std::vector<char>(image.GetData(), image.GetData() + image.GetSize()));
+
+	const char* data = image.GetData();
+	size_t size = image.GetSize();
+
+	Header header;
+	if (size < sizeof(header))
+		throw std::runtime_error("binary nod file is truncated");
+	memcpy(&header, data, sizeof(header));
+
+	if (header.byte_order != ByteOrderMark)
+		throw std::runtime_error("binary nod file was compiled for different byte order");
+
+	size_t pool_offset = sizeof(Header) + (size_t)header.num_entries * sizeof(Entry);
+	if (pool_offset > size || (header.num_entries > 0 && data[size - 1] != '\0'))
+		throw std::runtime_error("binary nod file is truncated");
+
+	const Entry* entries = reinterpret_cast<const Entry*>(data + sizeof(Header));
+	for (uint32_t i = 0; i < header.num_entries; i++) {
+		size_t name_pos = sizeof(Header) + i * sizeof(Entry) + entries[i].name_offset;
+		if (name_pos < pool_offset || name_pos >= size)
+			throw std::runtime_error("binary nod file is corrupt");
+		if (entries[i].number != (int)i)
+			throw std::runtime_error("entry index in file != real index, this is unexpected");
+	}
+
+	image_ = std::move(image);
+	entries_ = reinterpret_cast<const Entry*>(image_.GetData() + sizeof(Header));
+	num_entries_ = header.num_entries;
 }
 
 NodFile::~NodFile() {
 }
 
 const NodFile::Entry& NodFile::GetEntry(int index) const {
-	if (index < 0 || index >= (int)entries_.size())
+	if (index < 0 || index >= num_entries_)
 		throw std::runtime_error("entry does not exists in nod file");
 	return entries_[index];
 }
 
 int NodFile::GetNumEntries() const {
-	return entries_.size();
+	return num_entries_;
+}
+
+void NodFile::Save(const std::string& path) const {
+	std::ofstream stream(path, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+	stream.exceptions(std::ofstream::badbit | std::ofstream::failbit);
+
+	stream.write(image_.GetData(), image_.GetSize());
 }
@@ -20,10 +20,31 @@
 #ifndef NODFILE_HH
 #define NODFILE_HH
 
+#include <cstdint>
 #include <string>
-#include <vector>
 #include <map>
+#include <stdexcept>
 
+#include "filebuffer.hh"
+
+// Game scenario file
+//
+// Either original text file or a binary one produced from it by
+// opendaed-compile is accepted. Text files are converted into
+// the same binary image when loaded, so the rest of the code
+// works with the image only, and binary files are used as is.
+//
+// Binary image layout (all integers are in host byte order):
+//
+//   header:
+//     char[8]  signature "ODNODV01"
+//     uint32   byte order mark 0x01020304
+//     uint32   number of entries
+//   entries:
+//     int32    entry number
+//     int32    offset of NUL-terminated name from the entry start
+//     int32[24] fields
+//   string pool
 class NodFile {
 public:
 	enum class Condition {
@@ -39,16 +60,22 @@ public:
 	struct Entry {
 		typedef std::map<int, int> ConditionMap;
 
-		int number;
-		std::string name;
-		int fields[24];
+		int32_t number;
+		int32_t name_offset;
+		int32_t fields[24];
+
+		// entries only live inside the image, as names are
+		// addressed relative to them
+		Entry() = delete;
+		Entry(const Entry&) = delete;
+		Entry& operator=(const Entry&) = delete;
 
 		int GetType() const { return fields[0]; }
 		int GetStartFrame() const { return fields[1]; }
 		int GetEndFrame() const { return fields[2]; }
 		int GetActionStartFrame() const { return fields[3]; }
 		int GetActionEndFrame() const { return fields[4]; }
-		const std::string GetName() const { return name; }
+		const char* GetName() const { return reinterpret_cast<const char*>(this) + name_offset; }
 
 		int GetDefaultOffset() const { return fields[5]; }
 
@@ -60,28 +87,40 @@ public:
 			return conds;
 		}
 
+		// n-th of 8 (condition, offset) pairs
 		std::pair<int, int> GetCondition(int n) const {
-			return std::make_pair(fields[6 + n * 2 + 7], fields[6 + n * 2]);
+			if (n < 0 || n >= 8)
+				throw std::logic_error("condition index out of range");
+			return std::make_pair(fields[6 + n * 2 + 1], fields[6 + n * 2]);
 		}
 	};
 
 protected:
-	typedef std::vector<Entry> EntryVector;
+	FileBuffer image_;
+
+	const Entry* entries_;
+	int num_entries_;
 
 protected:
-	EntryVector entries_;
+	void Parse(const char* data, size_t size);
+	void Attach(FileBuffer&& image);
 
 public:
 	NodFile(const std::string& path);
+	NodFile(FileBuffer&& data);
+	NodFile(NodFile&& other) = default;
 	~NodFile();
 
 	const Entry& GetEntry(int index) const;
 	int GetNumEntries() const;
 
+	// write binary image
+	void Save(const std::string& path) const;
+
 	template<class F>
 	void ForEach(const F& processor) const {
-		for (auto& e : entries_)
-			processor(e);
+		for (int i = 0; i < num_entries_; i++)
+			processor(entries_[i]);
 	}
 };
 
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <getopt.h>
+
+#include <iostream>
+#include <string>
+
+#include "archive.hh"
+#include "datamanager.hh"
+
+void usage(const char* progname) {
+	std::cerr << "Usage: " << progname << " [ -a <payload alignment> ] <output archive> <path to data directory>" << std::endl;
+}
+
+int realmain(int argc, char** argv) {
+	const char* progname = argv[0];
+
+	uint32_t alignment = 4096;
+
+	int ch;
+	while ((ch = getopt(argc, argv, "a:h")) != -1) {
+		switch (ch) {
+		case 'a':
+			alignment = std::stoul(optarg);
+			break;
+		case 'h':
+			usage(progname);
+			return 0;
+		default:
+			usage(progname);
+			return 1;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2 || alignment == 0) {
+		usage(progname);
+		return 1;
+	}
+
+	// use the same rules to pick data files as the game itself
+	DataManager data_manager;
+	data_manager.ScanDir(argv[1]);
+
+	Archive::SourceVector sources;
+	data_manager.ForEachFile([&sources](const DataManager::FileInfo& file) {
+			if (file.archived)
+				throw std::runtime_error("repacking data archives is not supported");
+			sources.push_back({ file.name, file.path, (uint64_t)file.size, (int64_t)file.mtime });
+		});
+
+	Archive::Write(argv[0], sources, alignment);
+
+	std::cerr << "packed " << sources.size() << " files into " << argv[0] << std::endl;
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	try {
+		return realmain(argc, argv);
+	} catch (std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+
+	return 1;
+}
@@ -20,9 +20,12 @@
 #include <vector>
 #include <stdexcept>
 
+#include "tracer.hh"
+
 #include "quicktime.hh"
 
 QuickTime::QuickTime(const std::string& path) {
+	TraceSpan span("quicktime", "quicktime_open", path);
 	qt_ = quicktime_open(path.c_str(), 1, 0);
 	if (qt_ == nullptr)
 		throw std::runtime_error("quicktime_open failed");
@@ -73,6 +76,7 @@ lqt_sample_format_t QuickTime::GetSampleFormat(int track) const {
 }
 
 int QuickTime::SetVideoPosition(int64_t frame, int track) {
+	TraceSpan span("quicktime", "seek video");
 	return quicktime_set_video_position(qt_, frame, track);
 }
 
@@ -87,6 +91,7 @@ int QuickTime::DecodeVideo(unsigned char* pixels, int pitch, int track) {
 	for (int i = 0; i < height; i++)
 		row_pointers[i] = pixels + pitch * i;
 
+	TraceSpan span("quicktime", "decode video");
 	return quicktime_decode_video(qt_, row_pointers.data(), track);
 }
 
@@ -115,6 +120,7 @@ int64_t QuickTime::GetAudioPtsOffset(int track) const {
 }
 
 int QuickTime::SetAudioPosition(int64_t sample, int track) {
+	TraceSpan span("quicktime", "seek audio");
 	return quicktime_set_audio_position(qt_, sample, track);
 }
 
@@ -155,5 +161,6 @@ int QuickTime::DecodeAudioTrackInterleaved(int16_t* output_i, float* output_f, l
 }
 
 int QuickTime::DecodeAudioRaw(void* output, long samples, int track) {
+	TraceSpan span("quicktime", "decode audio");
 	return lqt_decode_audio_raw(qt_, output, samples, track);
 }
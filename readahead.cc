@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "localcache.hh"
+#include "logger.hh"
+#include "tracer.hh"
+
+#include "readahead.hh"
+
+ReadAhead::ReadAhead(const DataManager& data_manager, IoScheduler& io_scheduler, size_t max_outstanding_bytes)
+	: data_manager_(data_manager),
+	  io_scheduler_(io_scheduler),
+	  local_cache_(nullptr),
+	  max_outstanding_bytes_(max_outstanding_bytes),
+	  outstanding_bytes_(0),
+	  warmed_bytes_(0),
+	  processing_(false),
+	  current_stale_(false),
+	  cancel_current_(false),
+	  exiting_(false),
+	  thread_(&ReadAhead::Worker, this) {
+}
+
+ReadAhead::~ReadAhead() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		exiting_ = true;
+	}
+	cv_.notify_all();
+
+	// worker may be blocked on a speculative read which scheduler
+	// holds back while movie is playing
+	std::thread::id worker = thread_.get_id();
+	io_scheduler_.Abort(worker);
+	thread_.join();
+	io_scheduler_.Resume(worker);
+}
+
+void ReadAhead::SetLocalCache(LocalCache* local_cache) {
+	local_cache_ = local_cache;
+}
+
+bool ReadAhead::Process(const RequestInfo& request) {
+	if (request.copy) {
+		auto cancelled = [this]() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			return cancel_current_ || exiting_;
+		};
+
+		if (local_cache_ != nullptr)
+			return local_cache_->Fetch(request.id, data_manager_.GetFileInfo(request.id), request.priority, cancelled);
+		else
+			return data_manager_.Extract(request.id, request.priority, cancelled);
+	}
+
+	std::vector<char> buffer(CHUNK_SIZE);
+
+	off_t offset = request.offset;
+	size_t remaining = request.length;
+	while (remaining > 0) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (cancel_current_ || exiting_)
+				break;
+		}
+
+		ssize_t nread = data_manager_.Read(request.id, offset, std::min(remaining, buffer.size()), buffer.data(), request.priority);
+		if (nread <= 0)
+			break;
+
+		offset += nread;
+		remaining -= nread;
+	}
+
+	return remaining == 0;
+}
+
+void ReadAhead::Worker() {
+	Tracer::SetThreadName("readahead");
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (1) {
+		cv_.wait(lock, [this]() { return exiting_ || !queue_.empty(); });
+
+		if (exiting_)
+			return;
+
+		// take most urgent request, oldest first
+		RequestQueue::iterator next = std::min_element(queue_.begin(), queue_.end(), [](const RequestInfo& a, const RequestInfo& b) {
+				return a.priority < b.priority;
+			});
+
+		RequestInfo request = *next;
+		queue_.erase(next);
+		processing_ = true;
+		current_ = request;
+		current_stale_ = false;
+		cancel_current_ = false;
+
+		lock.unlock();
+		bool completed = Process(request);
+		lock.lock();
+
+		processing_ = false;
+		if (!current_stale_)
+			outstanding_bytes_ -= request.length;
+
+		if (completed && !request.copy) {
+			warmed_.push_back(request);
+			warmed_set_.insert(std::make_pair(request.id, request.offset));
+			warmed_bytes_ += request.length;
+
+			while (warmed_bytes_ > max_outstanding_bytes_) {
+				warmed_set_.erase(std::make_pair(warmed_.front().id, warmed_.front().offset));
+				warmed_bytes_ -= warmed_.front().length;
+				warmed_.pop_front();
+			}
+		}
+
+		if (completed) {
+			LOG(LogCategory::READAHEAD, LogLevel::DEBUG) << (!request.copy ? "warmed " : local_cache_ ? "cached " : "extracted ") << request.length << " bytes of " << data_manager_.GetFileInfo(request.id).name;
+		}
+	}
+}
+
+void ReadAhead::BeginHints() {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (auto& request : queue_)
+		outstanding_bytes_ -= request.length;
+
+	queue_.clear();
+
+	if (processing_ && !current_stale_) {
+		outstanding_bytes_ -= current_.length;
+		current_stale_ = true;
+	}
+}
+
+bool ReadAhead::Request(DataManager::FileId id, off_t offset, size_t length, IoScheduler::Priority priority) {
+	const DataManager::FileInfo& info = data_manager_.GetFileInfo(id);
+
+	bool copy = false;
+	if (local_cache_ != nullptr || info.archived) {
+		// files in local cache need no warm-up, and the rest are
+		// copied as a whole; same for archived files which have to
+		// be extracted before use
+		if (local_cache_ != nullptr ? local_cache_->IsCached(id, info) : data_manager_.IsExtracted(id))
+			return true;
+		offset = 0;
+		length = info.size;
+		copy = true;
+	} else {
+		// clip to file size
+		if (offset >= info.size)
+			return true;
+		length = std::min(length, (size_t)(info.size - offset));
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// already warmed, queued or being processed
+	if (warmed_set_.find(std::make_pair(id, offset)) != warmed_set_.end())
+		return true;
+	for (auto& request : queue_)
+		if (request.id == id && request.offset == offset)
+			return true;
+	if (processing_ && current_.id == id && current_.offset == offset) {
+		if (current_stale_) {
+			outstanding_bytes_ += current_.length;
+			current_stale_ = false;
+		}
+		return true;
+	}
+
+	// single file larger than the whole limit is only admitted
+	// when nothing else is outstanding
+	if (outstanding_bytes_ != 0 && outstanding_bytes_ + length > max_outstanding_bytes_)
+		return false;
+
+	queue_.push_back({ id, offset, length, priority, copy });
+	outstanding_bytes_ += length;
+
+	cv_.notify_one();
+
+	return true;
+}
+
+void ReadAhead::EndHints() {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (processing_ && current_stale_)
+		cancel_current_ = true;
+}
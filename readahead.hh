@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef READAHEAD_HH
+#define READAHEAD_HH
+
+#include <sys/types.h>
+
+#include <string>
+#include <deque>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "datamanager.hh"
+#include "ioscheduler.hh"
+
+class LocalCache;
+
+// Warms OS page cache for data files which are likely to be
+// needed soon, so e.g. first read of a movie doesn't stall on
+// CD-ROM spin-up and seek. Reads go through IoScheduler, so
+// they never delay data needed for playback. If local cache is
+// used, files are copied there as a whole instead, and archived
+// files are extracted in advance; these copies are counted
+// against the same limit
+class ReadAhead {
+protected:
+	struct RequestInfo {
+		DataManager::FileId id;
+		off_t offset;
+		size_t length;
+		IoScheduler::Priority priority;
+		bool copy; // copy whole file into local cache or extract it
+	};
+
+	typedef std::deque<RequestInfo> RequestQueue;
+	typedef std::set<std::pair<DataManager::FileId, off_t>> RequestSet;
+
+	enum {
+		CHUNK_SIZE = 256 * 1024,
+	};
+
+protected:
+	const DataManager& data_manager_;
+	IoScheduler& io_scheduler_;
+	LocalCache* local_cache_;
+
+	size_t max_outstanding_bytes_;
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+
+	RequestQueue queue_;
+	size_t outstanding_bytes_;
+
+	// ranges warmed recently, oldest first; only as much as fits
+	// into the limit is remembered, older data has likely been
+	// dropped from page cache since. Copies aren't recorded here,
+	// as local cache and extracted files know their own state
+	RequestQueue warmed_;
+	RequestSet warmed_set_;
+	size_t warmed_bytes_;
+
+	// request being processed by worker; it's cancelled if it's
+	// not requested again between BeginHints() and EndHints(), and
+	// while it's stale, it's not counted in outstanding bytes
+	bool processing_;
+	RequestInfo current_;
+	bool current_stale_;
+	bool cancel_current_;
+
+	bool exiting_;
+
+	std::thread thread_;
+
+protected:
+	void Worker();
+	bool Process(const RequestInfo& request);
+
+public:
+	ReadAhead(const DataManager& data_manager, IoScheduler& io_scheduler, size_t max_outstanding_bytes);
+	~ReadAhead();
+
+	void SetLocalCache(LocalCache* local_cache);
+
+	// start new set of hints: drop all pending requests, e.g. when
+	// player took another path and previously requested files are
+	// no longer interesting
+	void BeginHints();
+
+	// queue byte range of given file to be read in background
+	// (or whole file to be copied into local cache); returns false
+	// if request was dropped because of outstanding bytes limit
+	bool Request(DataManager::FileId id, off_t offset, size_t length, IoScheduler::Priority priority);
+
+	// finish set of hints: request in progress is cancelled if it
+	// wasn't repeated
+	void EndHints();
+};
+
+#endif // READAHEAD_HH
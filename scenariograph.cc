@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2014 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include "scenariograph.hh"
+
+ScenarioGraph::ScenarioGraph(const NodFile& nodfile) {
+	nodes_.resize(nodfile.GetNumEntries());
+
+	for (int index = 0; index < nodfile.GetNumEntries(); index++) {
+		const NodFile::Entry& entry = nodfile.GetEntry(index);
+		Node& node = nodes_[index];
+
+		node.entry = &entry;
+		node.next = Thread(nodfile, index + entry.GetDefaultOffset());
+
+		// same as NodFile::Entry::GetConditions(), but without
+		// building a map: later pair with the same condition
+		// replaces the earlier one
+		node.num_conditions = 0;
+		for (int i = 0; i < MAX_CONDITIONS; i++) {
+			std::pair<int, int> condition = entry.GetCondition(i);
+			if (condition.first == 0)
+				continue;
+
+			int slot = 0;
+			while (slot < node.num_conditions && node.conditions[slot].first != condition.first)
+				slot++;
+			if (slot == node.num_conditions)
+				node.num_conditions++;
+
+			node.conditions[slot] = std::make_pair(condition.first, Thread(nodfile, index + condition.second));
+		}
+
+		// hot zone rectangles use offsets of condition pairs
+		// by position, regardless of conditions themselves
+		for (int i = 0; i < MAX_CONDITIONS; i++)
+			node.rect_targets[i] = Thread(nodfile, index + entry.fields[6 + i * 2]);
+	}
+}
+
+bool ScenarioGraph::IsNoOp(const NodFile::Entry& entry) {
+	switch (entry.GetType()) {
+	case 1: // no-op, mostly used by "gate" entries
+	case 5: // enable user interface (not implemented yet)
+	case 30: // something hotzone-related
+	case 33: // unknown
+		return true;
+	default:
+		return false;
+	}
+}
+
+ScenarioGraph::NodeId ScenarioGraph::Thread(const NodFile& nodfile, int index) {
+	// chain longer than the script is certainly a loop
+	for (int step = 0; step <= nodfile.GetNumEntries(); step++) {
+		if (index < 0 || index >= nodfile.GetNumEntries())
+			return INVALID_NODE;
+
+		const NodFile::Entry& entry = nodfile.GetEntry(index);
+		if (!IsNoOp(entry))
+			return index;
+
+		index += entry.GetDefaultOffset();
+	}
+
+	return ENDLESS_LOOP;
+}
+
+const ScenarioGraph::Node& ScenarioGraph::GetNode(NodeId id) const {
+	if (id == ENDLESS_LOOP)
+		throw std::runtime_error("endless loop of no-op entries in nod file");
+	if (id < 0 || id >= (NodeId)nodes_.size())
+		throw std::runtime_error("entry does not exists in nod file");
+	return nodes_[id];
+}
+
+int ScenarioGraph::GetNumNodes() const {
+	return nodes_.size();
+}
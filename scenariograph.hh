@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2014 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCENARIOGRAPH_HH
+#define SCENARIOGRAPH_HH
+
+#include <utility>
+#include <vector>
+
+#include "nodfile.hh"
+
+// Compiled form of scenario script: jump targets are resolved from
+// relative offsets to node ids in advance, and chains of no-op
+// entries are skipped over (jump threading), so interpreter only
+// visits entries which actually do something.
+//
+// Node ids are entry indexes, so the script itself may still be
+// used to address entries. Invalid targets are kept and only
+// reported when interpreter actually tries to go there, as that
+// is how original scripts behave.
+class ScenarioGraph {
+public:
+	typedef int NodeId;
+
+	enum {
+		INVALID_NODE = -1, // target outside of the script
+		ENDLESS_LOOP = -2, // target is a loop of no-op entries
+
+		MAX_CONDITIONS = 8,
+	};
+
+	struct Node {
+		const NodFile::Entry* entry;
+
+		NodeId next; // default target
+
+		// control event handlers: condition code and target,
+		// unique by condition code and sorted by it
+		std::pair<int, NodeId> conditions[MAX_CONDITIONS];
+		int num_conditions;
+
+		// targets for hot zone rectangles
+		NodeId rect_targets[MAX_CONDITIONS];
+	};
+
+protected:
+	std::vector<Node> nodes_;
+
+protected:
+	static bool IsNoOp(const NodFile::Entry& entry);
+	static NodeId Thread(const NodFile& nodfile, int index);
+
+public:
+	ScenarioGraph(const NodFile& nodfile);
+
+	const Node& GetNode(NodeId id) const;
+	int GetNumNodes() const;
+};
+
+#endif // SCENARIOGRAPH_HH
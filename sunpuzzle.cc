@@ -19,12 +19,11 @@
 
 #include <algorithm>
 
-#include <SDL2/SDL_timer.h>
-
 #include "sunpuzzle.hh"
 
-#include "datamanager.hh"
+#include "clock.hh"
 #include "logger.hh"
+#include "tracer.hh"
 
 // TODO: no sounds
 
@@ -37,12 +36,13 @@ const std::array<SDL2pp::Point, 6> SunPuzzle::button_locations_ = { {
 	{ 228, 58},
 } };
 
-SunPuzzle::SunPuzzle(SDL2pp::Renderer& renderer, const DataManager& datamanager)
+SunPuzzle::SunPuzzle(SDL2pp::Renderer& renderer, TextureCache& textures, const Clock& clock)
 	: renderer_(renderer),
-	  background_(renderer, datamanager.GetPath("images/psun/od_bg2.bmp")),
-	  buttons_(renderer, datamanager.GetPath("images/psun/od_buttb.rle")),
-	  temperature_(renderer, datamanager.GetPath("images/psun/bigtempa.bmp")) {
-	Log("puzzle") << "starting sun puzzle";
+	  clock_(clock),
+	  background_(textures.Get("images/psun/od_bg2.bmp")),
+	  buttons_(textures.Get("images/psun/od_buttb.rle")),
+	  temperature_(textures.Get("images/psun/bigtempa.bmp")) {
+	Log(LogCategory::PUZZLE) << "starting sun puzzle";
 
 	std::fill(states_.begin(), states_.end(), 0);
 }
@@ -51,6 +51,8 @@ SunPuzzle::~SunPuzzle() {
 }
 
 bool SunPuzzle::ProcessEvent(const SDL_Event& event) {
+	TraceSpan span("puzzle", "sun process event");
+
 	if (event.type == SDL_MOUSEBUTTONDOWN) {
 		int nbutton = -1;
 		for (auto buttonloc = button_locations_.begin(); buttonloc != button_locations_.end(); buttonloc++) {
@@ -73,7 +75,7 @@ bool SunPuzzle::ProcessEvent(const SDL_Event& event) {
 			if (states_[i] != 2)
 				return true;
 
-		Log("puzzle") << "  congrats, puzzle is solved";
+		Log(LogCategory::PUZZLE) << "  congrats, puzzle is solved";
 			return false;
 	}
 
@@ -85,13 +87,15 @@ bool SunPuzzle::Update() {
 }
 
 void SunPuzzle::Render() {
+	TraceSpan span("puzzle", "sun render");
+
 	// background
-	renderer_.Copy(background_, SDL2pp::NullOpt, SDL2pp::Rect(0, 0, 640, 480));
+	renderer_.Copy(*background_, SDL2pp::NullOpt, SDL2pp::Rect(0, 0, 640, 480));
 
 	// buttons
 	for (int i = 0; i < 6; i++) {
 		renderer_.Copy(
-				buttons_,
+				*buttons_,
 				SDL2pp::Rect(42 * i, 42 * states_[i], 42, 42),
 				SDL2pp::Rect(button_locations_[i].x, button_locations_[i].y, 42, 42)
 			);
@@ -104,10 +108,10 @@ void SunPuzzle::Render() {
 
 	temperature = std::min(temperature * 5 / 12, 5);
 
-	int phase = (SDL_GetTicks() / 1000) % 6;
+	int phase = (clock_.GetTicks() / 1000) % 6;
 
 	renderer_.Copy(
-			temperature_,
+			*temperature_,
 			SDL2pp::Rect(100 * temperature, 120 * phase, 100, 120),
 			SDL2pp::Rect(264, 192, 100, 120)
 		);
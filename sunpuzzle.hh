@@ -22,12 +22,12 @@
 
 #include <array>
 
-#include <SDL2pp/Texture.hh>
 #include <SDL2pp/Renderer.hh>
 
 #include "screen.hh"
+#include "texturecache.hh"
 
-class DataManager;
+class Clock;
 
 class SunPuzzle : public Screen {
 private:
@@ -35,17 +35,18 @@ private:
 
 private:
 	SDL2pp::Renderer& renderer_;
+	const Clock& clock_;
 
 	// Textures
-	SDL2pp::Texture background_;
-	SDL2pp::Texture buttons_;
-	SDL2pp::Texture temperature_;
+	TextureCache::TexturePtr background_;
+	TextureCache::TexturePtr buttons_;
+	TextureCache::TexturePtr temperature_;
 
 private:
 	std::array<int, 6> states_;
 
 public:
-	SunPuzzle(SDL2pp::Renderer& renderer, const DataManager& datamanager);
+	SunPuzzle(SDL2pp::Renderer& renderer, TextureCache& textures, const Clock& clock);
 	virtual ~SunPuzzle();
 
 	bool ProcessEvent(const SDL_Event& event) override;
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "artemisboard.hh"
+
+// Checks that connectivity updated incrementally on rotation matches
+// connectivity traced from scratch, and that the solver finds minimal
+// solutions of Artemis puzzle
+
+namespace {
+
+enum {
+	NUM_RANDOM_ROTATIONS = 100000,
+
+	NUM_SCRAMBLES = 20,
+	NUM_SCRAMBLE_MOVES = 12,
+};
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+	if (!condition) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+void ApplyMoves(ArtemisBoard& board, const std::vector<ArtemisBoard::Move>& moves) {
+	for (const auto& move : moves)
+		board.RotatePiece(move.piece, move.clockwise);
+}
+
+bool operator==(const ArtemisBoard::Connectivity& a, const ArtemisBoard::Connectivity& b) {
+	return a.active == b.active && a.horizontal_lines == b.horizontal_lines &&
+		a.vertical_lines == b.vertical_lines && a.systems == b.systems;
+}
+
+bool IsSolved(const ArtemisBoard& board) {
+	return board.GetConnectivity().systems == ArtemisBoard::ALL_SYSTEMS;
+}
+
+}
+
+int main() {
+	std::mt19937 random(1);
+	std::vector<ArtemisBoard::Move> moves;
+
+	// random rotations, including the unused central piece
+	ArtemisBoard rotated;
+	bool all_equal = true;
+	for (int i = 0; i < NUM_RANDOM_ROTATIONS && all_equal; i++) {
+		rotated.RotatePiece(random() % ArtemisBoard::NUM_PIECES, random() & 1);
+		all_equal = rotated.GetConnectivity() == rotated.Trace();
+	}
+	Check(all_equal, "incremental connectivity matches traced one");
+
+	// initial board
+	ArtemisBoard solution;
+	Check(!IsSolved(solution), "initial board is not solved");
+	Check(solution.Solve(moves), "initial board is solvable");
+	Check(!moves.empty(), "initial board needs moves");
+	ApplyMoves(solution, moves);
+	Check(IsSolved(solution), "solution of initial board connects all systems");
+
+	// solved board
+	Check(solution.Solve(moves), "solved board is solvable");
+	Check(moves.empty(), "solved board needs 0 moves");
+
+	// solution may always be restored by undoing scrambling clicks,
+	// so minimal solution can't be longer. Counter-clockwise clicks
+	// are used since each is undone by a single clockwise click even
+	// with BUG2BUG, where only clockwise rotation is possible
+	for (int scramble = 0; scramble < NUM_SCRAMBLES; scramble++) {
+		ArtemisBoard board = solution;
+		for (int i = 0; i < NUM_SCRAMBLE_MOVES; i++) {
+			int n = random() % (ArtemisBoard::NUM_PIECES - 1);
+			if (n >= ArtemisBoard::CENTRAL_PIECE_NUMBER)
+				n++;
+			board.RotatePiece(n, false);
+		}
+
+		Check(board.Solve(moves), "scrambled board is solvable");
+		Check(moves.size() <= NUM_SCRAMBLE_MOVES, "scrambled board from a known solution is solved within N moves");
+		ApplyMoves(board, moves);
+		Check(IsSolved(board), "solution of scrambled board connects all systems");
+	}
+
+	if (failures != 0) {
+		std::cerr << failures << " check(s) failed" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
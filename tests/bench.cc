@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "datamanager.hh"
+#include "hotfile.hh"
+#include "logger.hh"
+#include "nodfile.hh"
+
+// Benchmarks of data access paths on synthetic data
+//
+// Each benchmark also checks that the implementation it measures
+// gives the same results as the straightforward one, and fails
+// otherwise, so these are also run as tests with smaller sizes.
+
+namespace {
+
+typedef std::chrono::steady_clock BenchClock;
+
+double MillisecondsSince(BenchClock::time_point start) {
+	return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+}
+
+// temporary directory removed with all its contents on destruction
+class TempDir {
+private:
+	std::string path_;
+
+private:
+	static int RemoveEntry(const char* path, const struct stat*, int, struct FTW*) {
+		return remove(path);
+	}
+
+public:
+	TempDir() {
+		const char* tmpdir = getenv("TMPDIR");
+		std::string pattern = std::string(tmpdir ? tmpdir : "/tmp") + "/opendaed-bench.XXXXXX";
+		if (mkdtemp(&pattern[0]) == nullptr)
+			throw std::runtime_error("cannot create temporary directory");
+		path_ = pattern;
+	}
+
+	~TempDir() {
+		nftw(path_.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+	}
+
+	const std::string& GetPath() const {
+		return path_;
+	}
+};
+
+void CreateFile(const std::string& path) {
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		throw std::runtime_error("cannot create " + path);
+	close(fd);
+}
+
+void MakeDir(const std::string& path) {
+	if (mkdir(path.c_str(), 0755) != 0)
+		throw std::runtime_error("cannot create " + path);
+}
+
+// Tree resembling contents of several game CDs copied into a single
+// directory: each disc has a few directories with many files, and
+// some file names repeat on different discs, so duplicate resolution
+// is exercised
+void CreateTree(const std::string& root, int num_files) {
+	const int num_discs = 4;
+	const int dirs_per_disc = 16;
+	const int files_per_dir = std::max(1, num_files / (num_discs * dirs_per_disc));
+
+	for (int disc = 0; disc < num_discs; disc++) {
+		std::string discpath = root + "/CD" + std::to_string(disc + 1);
+		MakeDir(discpath);
+		for (int dir = 0; dir < dirs_per_disc; dir++) {
+			std::string dirpath = discpath + "/DIR" + std::to_string(dir);
+			MakeDir(dirpath);
+			for (int file = 0; file < files_per_dir; file++) {
+				// every 8th file is shared between discs
+				int id = (file % 8 == 0) ? dir * files_per_dir + file : (disc * dirs_per_disc + dir) * files_per_dir + file + num_files;
+				CreateFile(dirpath + "/FILE" + std::to_string(id) + ".DAT");
+			}
+		}
+	}
+}
+
+std::map<std::string, std::string> CollectFiles(const DataManager& data_manager) {
+	std::map<std::string, std::string> result;
+	data_manager.ForEachFile([&result](const DataManager::FileInfo& info) {
+			result[info.name] = info.path;
+		});
+	return result;
+}
+
+// times scanning the tree with a single thread and with one thread
+// per core (at least two), and checks both find the same files in
+// the same places
+bool BenchScan(int num_files) {
+	TempDir tree;
+	CreateTree(tree.GetPath(), num_files);
+
+	DataManager sequential;
+	sequential.SetScanThreads(1);
+	BenchClock::time_point start = BenchClock::now();
+	sequential.ScanDir(tree.GetPath());
+	double sequential_ms = MillisecondsSince(start);
+
+	int threads = std::max(2u, std::thread::hardware_concurrency());
+	DataManager parallel;
+	parallel.SetScanThreads(threads);
+	start = BenchClock::now();
+	parallel.ScanDir(tree.GetPath());
+	double parallel_ms = MillisecondsSince(start);
+
+	std::map<std::string, std::string> sequential_files = CollectFiles(sequential);
+	std::map<std::string, std::string> parallel_files = CollectFiles(parallel);
+
+	std::cout << "scan: " << sequential_files.size() << " files, sequential " << sequential_ms << " ms, "
+		<< threads << " threads " << parallel_ms << " ms" << std::endl;
+
+	if (sequential_files != parallel_files) {
+		std::cerr << "scan: parallel scan result differs from sequential one" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+// times DataManager::Lookup() against a std::map of lower-cased
+// names, which is how DataManager used to resolve names, and checks
+// both resolve every name to the same file
+bool BenchLookup(int num_files) {
+	const int rounds = 20;
+
+	TempDir tree;
+	CreateTree(tree.GetPath(), num_files);
+
+	DataManager data_manager;
+	data_manager.ScanDir(tree.GetPath());
+
+	// baseline and queries in the form game scripts use: directory
+	// part and file name in original case
+	std::map<std::string, std::string> baseline;
+	std::vector<std::string> queries;
+	data_manager.ForEachFile([&baseline, &queries](const DataManager::FileInfo& info) {
+			baseline[info.name] = info.path;
+			queries.push_back("data/" + info.path.substr(info.path.rfind('/') + 1));
+		});
+
+	// scripts request files in no particular order
+	std::shuffle(queries.begin(), queries.end(), std::mt19937(1));
+
+	size_t checksum_map = 0;
+	BenchClock::time_point start = BenchClock::now();
+	for (int round = 0; round < rounds; round++) {
+		for (const auto& query : queries) {
+			std::string name = query.substr(query.rfind('/') + 1);
+			std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+			std::map<std::string, std::string>::const_iterator file = baseline.find(name);
+			if (file != baseline.end())
+				checksum_map += file->second.length();
+		}
+	}
+	double map_ms = MillisecondsSince(start);
+
+	size_t checksum_interned = 0;
+	start = BenchClock::now();
+	for (int round = 0; round < rounds; round++) {
+		for (const auto& query : queries) {
+			DataManager::FileId id = data_manager.Lookup(query);
+			if (id != DataManager::INVALID_FILE_ID)
+				checksum_interned += data_manager.GetPath(id).length();
+		}
+	}
+	double interned_ms = MillisecondsSince(start);
+
+	double lookups = (double)rounds * queries.size();
+	std::cout << "lookup: " << queries.size() << " files, map " << map_ms * 1000000.0 / lookups << " ns/lookup, "
+		<< "interned " << interned_ms * 1000000.0 / lookups << " ns/lookup" << std::endl;
+
+	for (const auto& query : queries) {
+		DataManager::FileId id = data_manager.Lookup(query);
+		std::string name = query.substr(query.rfind('/') + 1);
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		if (id == DataManager::INVALID_FILE_ID || data_manager.GetPath(id) != baseline[name]) {
+			std::cerr << "lookup: " << query << " resolved differently" << std::endl;
+			return false;
+		}
+	}
+
+	if (checksum_map != checksum_interned || data_manager.Lookup("data/nonexistent.dat") != DataManager::INVALID_FILE_ID) {
+		std::cerr << "lookup: results differ from map lookup" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+std::vector<char> GenerateNodText(int num_entries, std::mt19937& rng) {
+	std::string text;
+	for (int entry = 0; entry < num_entries; entry++) {
+		text += std::to_string(entry) + " movie" + std::to_string(rng() % 1000) + ".mov";
+		for (int field = 0; field < 24; field++)
+			text += " " + std::to_string((int)(rng() % 2000) - 1);
+		text += "\r\n";
+	}
+	return std::vector<char>(text.begin(), text.end());
+}
+
+std::vector<char> GenerateHotText(int num_frames, std::mt19937& rng) {
+	std::string text;
+	for (int frame = 0; frame < num_frames; frame++) {
+		text += std::to_string(frame);
+		for (int rect = 0; rect < HotFile::RECTS_PER_FRAME; rect++) {
+			if (rng() % 2) {
+				text += " 0 0 0 0";
+			} else {
+				int x1 = rng() % 300, y1 = rng() % 220;
+				text += " " + std::to_string(x1) + " " + std::to_string(y1) + " " + std::to_string(x1 + 1 + rng() % 20) + " " + std::to_string(y1 + 1 + rng() % 20);
+			}
+		}
+		text += "\r\n";
+	}
+	return std::vector<char>(text.begin(), text.end());
+}
+
+// nod and hot file parsers as they were before TextScanner, over
+// in-memory streams so only parsing is measured
+struct StreamNodEntry {
+	int number;
+	std::string name;
+	int fields[24];
+};
+
+std::vector<StreamNodEntry> StreamParseNod(const std::vector<char>& text) {
+	std::istringstream stream(std::string(text.begin(), text.end()));
+	std::vector<StreamNodEntry> entries;
+
+	while (!stream.eof()) {
+		StreamNodEntry e;
+		stream >> e.number >> e.name;
+
+		for (int i = 0; i < 24; i++)
+			stream >> e.fields[i];
+
+		if (stream.fail())
+			break;
+
+		entries.push_back(std::move(e));
+	}
+
+	return entries;
+}
+
+std::map<int, std::vector<SDL2pp::Rect>> StreamParseHot(const std::vector<char>& text) {
+	std::istringstream stream(std::string(text.begin(), text.end()));
+	std::map<int, std::vector<SDL2pp::Rect>> entries;
+
+	while (!stream.eof()) {
+		int frameno;
+		stream >> frameno;
+
+		if (stream.fail())
+			break;
+
+		std::vector<SDL2pp::Rect> rects;
+		for (int i = 0; i < 8; i++) {
+			int x1, y1, x2, y2;
+
+			stream >> x1 >> y1 >> x2 >> y2;
+
+			if (stream.fail())
+				break;
+
+			if (x1 != 0 || y1 != 0 || x2 != 0 || y2 != 0)
+				rects.emplace_back(x1, y1, x2 - x1, y2 - y1);
+		}
+
+		entries.emplace(std::make_pair(frameno, std::move(rects)));
+	}
+
+	return entries;
+}
+
+bool SameRect(const SDL2pp::Rect& a, const SDL2pp::Rect& b) {
+	return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+// times parsing generated text nod and hot files with NodFile and
+// HotFile, which use TextScanner, and with the iostream parsers
+// above, and checks they produce the same entries and rects
+bool BenchTextScan(int num_entries) {
+	std::mt19937 rng(1);
+	std::vector<char> nod_text = GenerateNodText(num_entries, rng);
+	std::vector<char> hot_text = GenerateHotText(num_entries, rng);
+
+	BenchClock::time_point start = BenchClock::now();
+	std::vector<StreamNodEntry> stream_nod = StreamParseNod(nod_text);
+	std::map<int, std::vector<SDL2pp::Rect>> stream_hot = StreamParseHot(hot_text);
+	double stream_ms = MillisecondsSince(start);
+
+	FileBuffer nod_data{std::vector<char>(nod_text)};
+	FileBuffer hot_data{std::vector<char>(hot_text)};
+
+	start = BenchClock::now();
+	NodFile nod(std::move(nod_data));
+	HotFile hot(hot_data);
+	double scanner_ms = MillisecondsSince(start);
+
+	std::cout << "textscan: " << nod_text.size() + hot_text.size() << " bytes, iostream " << stream_ms << " ms, "
+		<< "scanner " << scanner_ms << " ms" << std::endl;
+
+	if (nod.GetNumEntries() != (int)stream_nod.size() || (int)stream_nod.size() != num_entries) {
+		std::cerr << "textscan: nod entry count differs" << std::endl;
+		return false;
+	}
+
+	for (int i = 0; i < nod.GetNumEntries(); i++) {
+		const NodFile::Entry& entry = nod.GetEntry(i);
+		if (entry.number != stream_nod[i].number || stream_nod[i].name != entry.GetName() ||
+				!std::equal(stream_nod[i].fields, stream_nod[i].fields + 24, entry.fields)) {
+			std::cerr << "textscan: nod entry " << i << " differs" << std::endl;
+			return false;
+		}
+	}
+
+	if ((int)stream_hot.size() != num_entries) {
+		std::cerr << "textscan: hot frame count differs" << std::endl;
+		return false;
+	}
+
+	for (const auto& frame : stream_hot) {
+		HotFile::RectRange rects = hot.GetRectsForFrame(frame.first);
+		if (rects.size() != frame.second.size() || !std::equal(rects.begin(), rects.end(), frame.second.begin(), SameRect)) {
+			std::cerr << "textscan: hot frame " << frame.first << " differs" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " scan|lookup|textscan [ <size> ]" << std::endl;
+		return 1;
+	}
+
+	std::string name = argv[1];
+	int size = (argc >= 3) ? std::stoi(argv[2]) : 0;
+
+	Logger::SetLevels("all=warning");
+
+	try {
+		if (name == "scan")
+			return BenchScan(size ? size : 100000) ? 0 : 1;
+		if (name == "lookup")
+			return BenchLookup(size ? size : 100000) ? 0 : 1;
+		if (name == "textscan")
+			return BenchTextScan(size ? size : 100000) ? 0 : 1;
+	} catch (std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::cerr << "unknown benchmark " << name << std::endl;
+	return 1;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "gameeventlistener.hh"
+
+// Checks that scene transitions, i.e. resetting and installing
+// handlers the way Interpreter::Update() does, don't allocate
+
+namespace {
+
+unsigned long allocations = 0;
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+	if (!condition) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+// state captured by handlers, similar to what interpreter captures
+struct Scene {
+	int target;
+	const int* rect_targets;
+	int* result;
+};
+
+void InstallScene(GameEventListener& listener, const Scene& scene) {
+	listener.ResetHandlers();
+
+	int target = scene.target;
+	int* result = scene.result;
+	listener.AddControlEventHandler(GameInterface::ControlEvent::YES, [=]() {
+			*result = target;
+		});
+	listener.AddControlEventHandler(GameInterface::ControlEvent::NO, [=]() {
+			*result = -target;
+		});
+
+	const int* rect_targets = scene.rect_targets;
+	listener.AddPointEventHandler([=](const SDL2pp::Point& point) {
+			*result = rect_targets[point.x % 8];
+		});
+
+	listener.AddEndOfClipEventHandler([=]() {
+			*result = target + 1000;
+		});
+}
+
+}
+
+void* operator new(size_t size) {
+	allocations++;
+	if (void* ptr = malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+	free(ptr);
+}
+
+int main() {
+	GameEventListener listener;
+
+	const int rect_targets[8] = { 10, 11, 12, 13, 14, 15, 16, 17 };
+	int result = 0;
+
+	// dispatch goes to handlers of the given event only
+	InstallScene(listener, Scene{ 1, rect_targets, &result });
+	listener.ProcessControlEvent(GameInterface::ControlEvent::NO);
+	Check(result == -1, "control event is dispatched to its handler");
+	result = 0;
+	listener.ProcessControlEvent(GameInterface::ControlEvent::DEPLOY);
+	Check(result == 0, "control event without handlers is ignored");
+	listener.ProcessPointEvent(SDL2pp::Point(3, 0));
+	Check(result == 13, "point event is dispatched");
+
+	// handler state stack, as used by puzzles on top of a scene
+	listener.PushHandlerState();
+	listener.AddControlEventHandler(GameInterface::ControlEvent::DEPLOY, [&result]() {
+			result = 42;
+		});
+	listener.ProcessControlEvent(GameInterface::ControlEvent::DEPLOY);
+	Check(result == 42, "pushed handler is called");
+	listener.PopHandlerState();
+	result = 0;
+	listener.ProcessControlEvent(GameInterface::ControlEvent::DEPLOY);
+	Check(result == 0, "popped handler is removed");
+
+	// steady state transitions
+	unsigned long before = allocations;
+	for (int scene = 0; scene < 1000; scene++) {
+		InstallScene(listener, Scene{ scene, rect_targets, &result });
+
+		listener.ProcessControlEvent(GameInterface::ControlEvent::YES);
+		Check(result == scene, "handler of current scene is called");
+
+		listener.PushHandlerState();
+		listener.AddControlEventHandler(GameInterface::ControlEvent::DEPLOY, [&result]() {
+				result = 42;
+			});
+		listener.PopHandlerState();
+
+		listener.ProcessEndOfClipEvent();
+		Check(result == scene + 1000, "end of clip handler is called");
+	}
+	Check(allocations == before, "scene transitions don't allocate");
+
+	if (failures != 0) {
+		std::cerr << failures << " check(s) failed, " << allocations - before << " allocation(s)" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
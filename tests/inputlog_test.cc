@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "inputlog.hh"
+
+// Checks that replaying a recorded session reproduces it exactly:
+// a toy game loop, in which a click competes with the end of clip,
+// is run with irregular frame timing and random input, then run
+// again from the recording, and outcomes are compared
+
+namespace {
+
+const Clock::Time Frequency = 1000000000;
+const Clock::Time ClipLength = Frequency / 10;
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+	if (!condition) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+// what game logic decided on each frame, same as interpreter does
+// with its control and end of clip handlers
+struct Outcome {
+	unsigned long frame;
+	Clock::Time time;
+	int clip;
+	bool clicked;
+
+	bool operator==(const Outcome& other) const {
+		return frame == other.frame && time == other.time && clip == other.clip && clicked == other.clicked;
+	}
+};
+
+class Game {
+private:
+	VirtualClock clock_;
+	int clip_;
+	Clock::Time clip_start_;
+	unsigned long frame_;
+	std::vector<Outcome> outcomes_;
+
+public:
+	Game() : clock_(Frequency), clip_(0), clip_start_(0), frame_(0) {
+	}
+
+	void BeginFrame(Clock::Time time) {
+		clock_.SetTime(time);
+		frame_++;
+	}
+
+	void ProcessEvent(const SDL_Event& event) {
+		if (event.type == SDL_MOUSEBUTTONDOWN && clock_.GetTime() < clip_start_ + ClipLength) {
+			outcomes_.push_back(Outcome{ frame_, clock_.GetTime(), clip_, true });
+			clip_++;
+			clip_start_ = clock_.GetTime();
+		}
+	}
+
+	void Update() {
+		if (clock_.GetTime() >= clip_start_ + ClipLength) {
+			outcomes_.push_back(Outcome{ frame_, clock_.GetTime(), clip_, false });
+			clip_++;
+			clip_start_ = clock_.GetTime();
+		}
+	}
+
+	const std::vector<Outcome>& GetOutcomes() const {
+		return outcomes_;
+	}
+};
+
+std::vector<Outcome> RecordSession(const std::string& path, unsigned long frames, unsigned long& clicks) {
+	std::mt19937 rng(1);
+	Game game;
+	InputRecorder recorder(path, Frequency, "start.nod", 3, "");
+
+	clicks = 0;
+	Clock::Time time = 0;
+	for (unsigned long frame = 0; frame < frames; frame++) {
+		// wall clock frame time jitters between 1 and 40 ms
+		time += Frequency / 1000 + rng() % (Frequency / 25);
+
+		game.BeginFrame(time);
+		recorder.BeginFrame(time);
+
+		if (rng() % 16 == 0) {
+			SDL_Event event = SDL_Event();
+			event.type = SDL_MOUSEBUTTONDOWN;
+			event.button.button = 1;
+			event.button.x = rng() % 640;
+			event.button.y = rng() % 480;
+
+			recorder.Record(event);
+			game.ProcessEvent(event);
+			clicks++;
+		}
+
+		// not reacted to, so not recorded
+		SDL_Event ignored = SDL_Event();
+		ignored.type = SDL_WINDOWEVENT;
+		recorder.Record(ignored);
+
+		game.Update();
+	}
+
+	return game.GetOutcomes();
+}
+
+std::vector<Outcome> ReplaySession(const std::string& path, unsigned long& frames, unsigned long& clicks) {
+	Game game;
+	InputReplayer replayer(path);
+
+	Check(replayer.GetStartNod() == "start.nod", "start nod is replayed");
+	Check(replayer.GetStartEntry() == 3, "start entry is replayed");
+	Check(replayer.GetPuzzle().empty(), "empty puzzle is replayed");
+	Check(replayer.GetFrequency() == Frequency, "clock frequency is replayed");
+
+	frames = 0;
+	clicks = 0;
+	Clock::Time time;
+	while (replayer.NextFrame(time)) {
+		game.BeginFrame(time);
+		frames++;
+
+		SDL_Event event;
+		while (replayer.Poll(event)) {
+			game.ProcessEvent(event);
+			clicks++;
+		}
+
+		game.Update();
+	}
+
+	return game.GetOutcomes();
+}
+
+}
+
+int main() {
+	const char* tmpdir = getenv("TMPDIR");
+	std::string path = std::string(tmpdir ? tmpdir : "/tmp") + "/opendaed-inputlog-test." + std::to_string(getpid()) + ".txt";
+
+	const unsigned long num_frames = 5000;
+
+	unsigned long recorded_clicks;
+	std::vector<Outcome> recorded = RecordSession(path, num_frames, recorded_clicks);
+
+	unsigned long replayed_frames, replayed_clicks;
+	std::vector<Outcome> replayed = ReplaySession(path, replayed_frames, replayed_clicks);
+
+	remove(path.c_str());
+
+	Check(replayed_frames == num_frames, "all frames are replayed");
+	Check(replayed_clicks == recorded_clicks, "all events are replayed");
+	Check(!recorded.empty(), "session has outcomes");
+	Check(replayed == recorded, "replayed session has the same outcomes on the same frames");
+
+	if (failures != 0) {
+		std::cerr << failures << " check(s) failed" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEXTSCANNER_HH
+#define TEXTSCANNER_HH
+
+#include <climits>
+#include <cstddef>
+
+// Whitespace separated tokens reader over in-memory text, used
+// for original game data files. Behaves like reading from
+// std::istream with operator>>, but doesn't allocate memory and
+// doesn't care about locales
+class TextScanner {
+protected:
+	const char* pos_;
+	const char* end_;
+
+protected:
+	static bool IsSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	void SkipSpace() {
+		while (pos_ != end_ && IsSpace(*pos_))
+			pos_++;
+	}
+
+public:
+	TextScanner(const char* data, size_t size) : pos_(data), end_(data + size) {
+	}
+
+	bool ReadInt(int& value) {
+		SkipSpace();
+
+		const char* pos = pos_;
+		bool negative = false;
+		if (pos != end_ && (*pos == '-' || *pos == '+'))
+			negative = *pos++ == '-';
+
+		if (pos == end_ || *pos < '0' || *pos > '9')
+			return false;
+
+		// accumulate as negative, which has larger range
+		long long result = 0;
+		for (; pos != end_ && *pos >= '0' && *pos <= '9'; pos++) {
+			result = result * 10 - (*pos - '0');
+			if (result < (long long)INT_MIN - 1)
+				return false;
+		}
+
+		if (!negative)
+			result = -result;
+		if (result < INT_MIN || result > INT_MAX)
+			return false;
+
+		value = (int)result;
+		pos_ = pos;
+		return true;
+	}
+
+	bool ReadWord(const char*& word, size_t& length) {
+		SkipSpace();
+
+		if (pos_ == end_)
+			return false;
+
+		word = pos_;
+		while (pos_ != end_ && !IsSpace(*pos_))
+			pos_++;
+		length = pos_ - word;
+
+		return true;
+	}
+};
+
+#endif // TEXTSCANNER_HH
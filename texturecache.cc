@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <SDL2/SDL_pixels.h>
+#include <SDL2/SDL_rwops.h>
+
+#include <SDL2pp/RWops.hh>
+
+#include "logger.hh"
+#include "tracer.hh"
+
+#include "datamanager.hh"
+
+#include "texturecache.hh"
+
+TextureCache::TextureCache(SDL2pp::Renderer& renderer, const DataManager& data_manager, size_t budget)
+	: renderer_(renderer),
+	  data_manager_(data_manager),
+	  budget_(budget),
+	  resident_bytes_(0),
+	  hits_(0),
+	  misses_(0),
+	  evictions_(0) {
+}
+
+TextureCache::~TextureCache() {
+	Log(LogCategory::TEXCACHE) << "hits: " << hits_ << ", misses: " << misses_ << ", evictions: " << evictions_ << ", resident: " << resident_bytes_ << " bytes";
+}
+
+size_t TextureCache::GetTextureSize(const SDL2pp::Texture& texture) {
+	// this is only an estimate of what renderer actually allocates
+	// in video (or, for software renderer, system) memory
+	int bpp = SDL_BYTESPERPIXEL(texture.GetFormat());
+	if (bpp == 0)
+		bpp = 4;
+	return (size_t)texture.GetWidth() * (size_t)texture.GetHeight() * (size_t)bpp;
+}
+
+void TextureCache::Evict() {
+	// textures still referenced from outside (e.g. by currently
+	// active screen) cannot be freed, so only the rest counts
+	// against the budget
+	size_t unreferenced_bytes = 0;
+	for (const auto& entry : entries_)
+		if (entry.texture.use_count() == 1)
+			unreferenced_bytes += entry.size;
+
+	// walk from least recently used entry
+	EntryList::iterator entry = entries_.end();
+	while (unreferenced_bytes > budget_ && entry != entries_.begin()) {
+		--entry;
+
+		if (entry->texture.use_count() > 1)
+			continue;
+
+		LOG(LogCategory::TEXCACHE, LogLevel::DEBUG) << "evicting " << entry->path << " (" << entry->size << " bytes)";
+
+		unreferenced_bytes -= entry->size;
+		resident_bytes_ -= entry->size;
+		evictions_++;
+
+		index_.erase(entry->path);
+		entry = entries_.erase(entry);
+	}
+}
+
+TextureCache::TexturePtr TextureCache::Get(const std::string& path) {
+	EntryMap::iterator existing = index_.find(path);
+	if (existing != index_.end()) {
+		// move to the front of LRU list
+		entries_.splice(entries_.begin(), entries_, existing->second);
+		hits_++;
+		return existing->second->texture;
+	}
+
+	misses_++;
+
+	TraceSpan span("texcache", "load texture", path);
+
+	FileBuffer data = data_manager_.Load(path);
+	SDL2pp::RWops rwops(SDL_RWFromConstMem(data.GetData(), data.GetSize()));
+
+	TexturePtr texture = std::make_shared<SDL2pp::Texture>(renderer_, rwops);
+	size_t size = GetTextureSize(*texture);
+
+	entries_.push_front({ path, texture, size });
+	index_.insert(std::make_pair(path, entries_.begin()));
+	resident_bytes_ += size;
+
+	Evict();
+
+	return texture;
+}
+
+void TextureCache::SetBudget(size_t budget) {
+	budget_ = budget;
+	Evict();
+}
+
+void TextureCache::Purge() {
+	size_t budget = budget_;
+	budget_ = 0;
+	Evict();
+	budget_ = budget;
+}
+
+size_t TextureCache::GetBudget() const {
+	return budget_;
+}
+
+size_t TextureCache::GetResidentBytes() const {
+	return resident_bytes_;
+}
+
+unsigned long TextureCache::GetHits() const {
+	return hits_;
+}
+
+unsigned long TextureCache::GetMisses() const {
+	return misses_;
+}
+
+unsigned long TextureCache::GetEvictions() const {
+	return evictions_;
+}
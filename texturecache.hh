@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEXTURECACHE_HH
+#define TEXTURECACHE_HH
+
+#include <string>
+#include <map>
+#include <list>
+#include <memory>
+
+#include <SDL2pp/Texture.hh>
+#include <SDL2pp/Renderer.hh>
+
+class DataManager;
+
+class TextureCache {
+public:
+	typedef std::shared_ptr<SDL2pp::Texture> TexturePtr;
+
+protected:
+	struct CacheEntry {
+		std::string path;
+		TexturePtr texture;
+		size_t size;
+	};
+
+	typedef std::list<CacheEntry> EntryList;
+	typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+protected:
+	SDL2pp::Renderer& renderer_;
+	const DataManager& data_manager_;
+
+	// entries are kept in most recently used first order
+	EntryList entries_;
+	EntryMap index_;
+
+	size_t budget_;
+	size_t resident_bytes_;
+
+	unsigned long hits_;
+	unsigned long misses_;
+	unsigned long evictions_;
+
+protected:
+	static size_t GetTextureSize(const SDL2pp::Texture& texture);
+
+	void Evict();
+
+public:
+	TextureCache(SDL2pp::Renderer& renderer, const DataManager& data_manager, size_t budget);
+	~TextureCache();
+
+	TexturePtr Get(const std::string& path);
+
+	void SetBudget(size_t budget);
+	void Purge();
+
+	size_t GetBudget() const;
+	size_t GetResidentBytes() const;
+	unsigned long GetHits() const;
+	unsigned long GetMisses() const;
+	unsigned long GetEvictions() const;
+};
+
+#endif // TEXTURECACHE_HH
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "logger.hh"
+
+#include "tracer.hh"
+
+namespace {
+
+void WriteJsonString(std::ostream& stream, const char* str) {
+	stream << '"';
+	for (; *str != '\0'; str++) {
+		unsigned char c = *str;
+		if (c == '"' || c == '\\') {
+			stream << '\\' << c;
+		} else if (c < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			stream << escaped;
+		} else {
+			stream << c;
+		}
+	}
+	stream << '"';
+}
+
+}
+
+std::atomic<bool> Tracer::enabled_(false);
+std::chrono::steady_clock::time_point Tracer::epoch_;
+std::mutex Tracer::buffers_mutex_;
+std::list<Tracer::ThreadBuffer> Tracer::buffers_;
+std::vector<Tracer::ThreadBuffer*> Tracer::free_buffers_;
+thread_local Tracer::ThreadBufferHolder Tracer::thread_buffer_ = { nullptr };
+
+Tracer::ThreadBufferHolder::~ThreadBufferHolder() {
+	if (buffer != nullptr) {
+		std::lock_guard<std::mutex> lock(buffers_mutex_);
+		free_buffers_.push_back(buffer);
+	}
+}
+
+Tracer::Tracer(const std::string& path) : path_(path) {
+	if (enabled_.load())
+		throw std::logic_error("only one tracer may exist at a time");
+
+	epoch_ = std::chrono::steady_clock::now();
+	enabled_.store(true);
+}
+
+Tracer::~Tracer() {
+	enabled_.store(false);
+
+	try {
+		Export();
+	} catch (std::exception& e) {
+		Log(LogCategory::TRACE, LogLevel::ERROR) << "cannot write trace: " << e.what();
+	}
+}
+
+Tracer::ThreadBuffer& Tracer::GetThreadBuffer() {
+	if (thread_buffer_.buffer == nullptr) {
+		std::lock_guard<std::mutex> lock(buffers_mutex_);
+
+		if (!free_buffers_.empty()) {
+			// events of the previous owner are kept until
+			// overwritten, but the name is not
+			ThreadBuffer* buffer = free_buffers_.back();
+			free_buffers_.pop_back();
+
+			std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+			buffer->name = nullptr;
+
+			thread_buffer_.buffer = buffer;
+		} else {
+			buffers_.emplace_back();
+
+			ThreadBuffer& buffer = buffers_.back();
+			buffer.tid = buffers_.size();
+			buffer.name = nullptr;
+			buffer.events.resize(EVENTS_PER_THREAD);
+			buffer.next = 0;
+			buffer.wrapped = false;
+
+			thread_buffer_.buffer = &buffer;
+		}
+	}
+
+	return *thread_buffer_.buffer;
+}
+
+uint64_t Tracer::Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch_).count();
+}
+
+void Tracer::CopyDetail(char* buffer, const char* detail) {
+	if (detail == nullptr) {
+		buffer[0] = '\0';
+		return;
+	}
+
+	size_t length = strlen(detail);
+	if (length >= DETAIL_SIZE) {
+		detail += length - (DETAIL_SIZE - 1);
+		length = DETAIL_SIZE - 1;
+	}
+	memcpy(buffer, detail, length);
+	buffer[length] = '\0';
+}
+
+void Tracer::Record(const char* category, const char* name, const char* detail, uint64_t start_us, uint64_t duration_us) {
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+
+	Event& event = buffer.events[buffer.next];
+	event.category = category;
+	event.name = name;
+	event.start_us = start_us;
+	event.duration_us = duration_us;
+
+	CopyDetail(event.detail, detail);
+
+	if (++buffer.next == buffer.events.size()) {
+		buffer.next = 0;
+		buffer.wrapped = true;
+	}
+}
+
+void Tracer::SetThreadName(const char* name) {
+	if (!IsEnabled())
+		return;
+
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.name = name;
+}
+
+void Tracer::Export() const {
+	std::ofstream stream(path_, std::ios_base::out | std::ios_base::trunc);
+	stream.exceptions(std::ofstream::badbit | std::ofstream::failbit);
+
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+	size_t count = 0;
+
+	std::lock_guard<std::mutex> buffers_lock(buffers_mutex_);
+	for (auto& buffer : buffers_) {
+		std::lock_guard<std::mutex> lock(buffer.mutex);
+
+		if (buffer.name != nullptr) {
+			stream << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.tid << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+			WriteJsonString(stream, buffer.name);
+			stream << "}}";
+			first = false;
+		}
+
+		// oldest events first
+		size_t nevents = buffer.wrapped ? buffer.events.size() : buffer.next;
+		size_t start = buffer.wrapped ? buffer.next : 0;
+		for (size_t i = 0; i < nevents; i++) {
+			const Event& event = buffer.events[(start + i) % buffer.events.size()];
+
+			stream << (first ? "" : ",\n") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.tid << ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us << ",\"cat\":";
+			WriteJsonString(stream, event.category);
+			stream << ",\"name\":";
+			WriteJsonString(stream, event.name);
+			if (event.detail[0] != '\0') {
+				stream << ",\"args\":{\"detail\":";
+				WriteJsonString(stream, event.detail);
+				stream << "}";
+			}
+			stream << "}";
+			first = false;
+			count++;
+		}
+	}
+
+	stream << "\n]}\n";
+
+	Log(LogCategory::TRACE) << "wrote " << count << " trace events to " << path_;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2015 Dmitry Marakasov
+ *
+ * This file is part of opendaed.
+ *
+ * opendaed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendaed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with opendaed.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACER_HH
+#define TRACER_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Collector of trace spans
+//
+// Spans are recorded into per-thread ring buffers, so only the
+// latest events of each thread are kept; recording takes an
+// uncontended per-thread lock. Buffers of exited threads are
+// reused by new ones, so short-lived threads (such as audio
+// callback thread, which is created for each clip) don't pile up
+// buffers; such threads share a single timeline in the trace.
+// Tracing is only active while Tracer instance exists, and
+// otherwise TraceSpan costs a single check. Collected spans may be
+// exported as Chrome trace event JSON (viewable with
+// chrome://tracing or Perfetto) at any time, and are exported to
+// given file on destruction.
+class Tracer {
+public:
+	enum {
+		EVENTS_PER_THREAD = 16384,
+		DETAIL_SIZE = 48,
+	};
+
+protected:
+	struct Event {
+		const char* category;
+		const char* name;
+		uint64_t start_us;
+		uint64_t duration_us;
+		char detail[DETAIL_SIZE];
+	};
+
+	struct ThreadBuffer {
+		std::mutex mutex;
+		int tid;
+		const char* name;
+		std::vector<Event> events;
+		size_t next;
+		bool wrapped;
+	};
+
+	// returns buffer to the free list when its thread exits
+	struct ThreadBufferHolder {
+		ThreadBuffer* buffer;
+
+		~ThreadBufferHolder();
+	};
+
+protected:
+	static std::atomic<bool> enabled_;
+	static std::chrono::steady_clock::time_point epoch_;
+
+	static std::mutex buffers_mutex_;
+	static std::list<ThreadBuffer> buffers_; // never shrinks, as exited threads' events are still exported
+	static std::vector<ThreadBuffer*> free_buffers_;
+
+	static thread_local ThreadBufferHolder thread_buffer_;
+
+protected:
+	std::string path_;
+
+protected:
+	static ThreadBuffer& GetThreadBuffer();
+
+public:
+	Tracer(const std::string& path);
+	~Tracer();
+
+	static bool IsEnabled() {
+		return enabled_.load(std::memory_order_relaxed);
+	}
+
+	// microseconds since tracing was started
+	static uint64_t Now();
+
+	// copy detail string into DETAIL_SIZE buffer; if it's too long,
+	// its tail is kept, as it's the most specific part of paths
+	static void CopyDetail(char* buffer, const char* detail);
+
+	static void Record(const char* category, const char* name, const char* detail, uint64_t start_us, uint64_t duration_us);
+
+	// name current thread in exported trace
+	static void SetThreadName(const char* name);
+
+	void Export() const;
+};
+
+// Scoped trace span, recorded on destruction
+//
+// Category and name must be string literals; detail is copied
+class TraceSpan {
+private:
+	const char* category_;
+	const char* name_;
+	bool enabled_;
+	uint64_t start_us_;
+	char detail_[Tracer::DETAIL_SIZE];
+
+public:
+	TraceSpan(const char* category, const char* name, const char* detail = nullptr) : category_(category), name_(name), enabled_(Tracer::IsEnabled()), start_us_(0) {
+		if (enabled_) {
+			Tracer::CopyDetail(detail_, detail);
+			start_us_ = Tracer::Now();
+		}
+	}
+
+	TraceSpan(const char* category, const char* name, const std::string& detail) : TraceSpan(category, name, detail.c_str()) {
+	}
+
+	~TraceSpan() {
+		if (enabled_)
+			Tracer::Record(category_, name_, detail_, start_us_, Tracer::Now() - start_us_);
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#endif // TRACER_HH